@@ -31,6 +31,7 @@
 #include "rpi-armtimer.h"
 #include "rpi-systimer.h"
 #include "rpi-interrupts.h"
+#include "tick.h"
 
 __attribute__((always_inline)) static inline void enable_interrupts()
 {
@@ -50,40 +51,18 @@ __attribute__((always_inline)) static inline void no_operation()
 #define DISABLE() disable_interrupts()
 #define ENABLE() enable_interrupts()
 #define MAXINT 0x7fffffff
+// Time unit of the task set below, one tick of initTimerInterrupts()
+#define TIME_UNIT_US 1000000
+#define TICK_HZ (1000000 / TIME_UNIT_US)
 
 // Mutex variable to guard critical sections
 mutex mute = MUTEX_INIT;
 
-// @brief The BCM2835 Interupt controller peripheral at it's base address
-static rpi_irq_controller_t *rpiIRQController =
-    (rpi_irq_controller_t *)RPI_INTERRUPT_CONTROLLER_BASE;
-
-// @brief Return the IRQ Controller register set
-static rpi_irq_controller_t *RPI_GetIrqController(void)
-{
-    return rpiIRQController;
-}
-
-void RPI_EnableARMTimerInterrupt(void)
-{
-    RPI_GetIrqController()->Enable_Basic_IRQs = RPI_BASIC_ARM_TIMER_IRQ;
-}
-
 void initTimerInterrupts()
 {
-    RPI_EnableARMTimerInterrupt();
-    /* Setup the system timer interrupt
-       Timer frequency = Clk/256 * 0x400
-       0xF3C is about 1 second
-     0xF3C - 3900 - 9953
-    */
-    RPI_GetArmTimer()->Load = 0xF3C;
-    /* Setup the ARM Timer */
-    RPI_GetArmTimer()->Control =
-        RPI_ARMTIMER_CTRL_23BIT |
-        RPI_ARMTIMER_CTRL_ENABLE |
-        RPI_ARMTIMER_CTRL_INT_ENABLE |
-        RPI_ARMTIMER_CTRL_PRESCALE_256;
+    /* Setup the ARM Timer for one tick per TIME_UNIT_US, calibrated
+       against the core clock */
+    kernel_set_tick_hz(TICK_HZ);
     /* Enable interrupts! */
     ENABLE();
 }
@@ -106,7 +85,7 @@ void computeSomethingForever(int seg)
  */
 void computeSomething(int seg)
 {
-    volatile int t = ticks;
+    volatile unsigned int t = ticks;
     ExpStruct *value = iexp(10);
     printf_at_seg(seg % 4, "S%d: %d", seg, t);
     while (t == ticks)
@@ -117,12 +96,13 @@ int main()
 {
     piface_init();
     piface_puts("DT8025 - A4P2");
-    RPI_WaitMicroSeconds(2000000);
+    thread_sleep_us(2000000);
     piface_clear();
 
-    spawnWithDeadline(computeSomething, 0, 5, 5);
-    spawnWithDeadline(computeSomething, 1, 3, 3);
-    spawnWithDeadline(computeSomething, 2, 4, 4);
+    uint64_t now = RPI_GetTimeMicroSeconds();
+    spawnWithDeadline(computeSomething, 0, now + 5 * TIME_UNIT_US, 5 * TIME_UNIT_US);
+    spawnWithDeadline(computeSomething, 1, now + 3 * TIME_UNIT_US, 3 * TIME_UNIT_US);
+    spawnWithDeadline(computeSomething, 2, now + 4 * TIME_UNIT_US, 4 * TIME_UNIT_US);
 
     initTimerInterrupts();
 
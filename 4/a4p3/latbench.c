@@ -0,0 +1,133 @@
+/*
+ * Interrupt-to-dispatch latency benchmark for TinyThreads.
+ *
+ * Measures the time from the ARM timer IRQ to the resume of the thread
+ * selected by the scheduler, i.e., the path irq_entry -> interrupt_vector
+ * -> irq_exit -> scheduler -> respawn_periodic_tasks -> scheduler_X
+ * -> yield -> dispatch, for every scheduling policy and an increasing
+ * number of periodic threads. Results are reported via UART.
+ * The "sync" runs release all threads on the same tick, which stresses
+ * the release of many jobs at once. The "fiq" runs take the tick on the
+ * FIQ fast path, which hands the reschedule to a core-local mailbox IRQ.
+ *
+ * Build with: make MAINFILE=latbench
+ * and compare with the per-item release: make MAINFILE=latbench RELEASE=item
+ * or with the hot path linked in place: make MAINFILE=latbench FAST=0
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "tinythreads.h"
+#include "rpi3.h"
+#include "uart.h"
+#include "latency.h"
+
+#include "rpi-armtimer.h"
+#include "rpi-systimer.h"
+#include "rpi-interrupts.h"
+#include "tick.h"
+
+__attribute__((always_inline)) static inline void enable_interrupts()
+{
+    __asm volatile("cpsie i \n");
+}
+
+__attribute__((always_inline)) static inline void no_operation()
+{
+    __asm volatile("nop \n"); // AIF
+}
+
+#define ENABLE() enable_interrupts()
+
+#define BENCH_TICK_US       1000
+/* Samples collected per policy and thread count */
+#define BENCH_SAMPLES       500
+/* Busy time of each job, well below the shortest period */
+#define BENCH_WORK_US       150
+/* Maximum number of worker threads, i.e., NTHREADS in tinythreads.c */
+#define BENCH_MAX_WORKERS   8
+/* Common period of the sync runs, long enough for all workers to finish */
+#define BENCH_SYNC_PERIOD   (2 * BENCH_MAX_WORKERS * BENCH_TICK_US)
+
+// @brief Set to make every worker return immediately at its next release.
+static volatile bool stop = false;
+
+void initTimerInterrupts()
+{
+    if (kernel_set_tick_hz(1000000 / BENCH_TICK_US) != 0)
+        print2uart("tick off by more than %d ppm\n", TICK_TOLERANCE_PPM);
+    print2uart("APB %u Hz, tick %u ns\n", kernel_apb_hz(), kernel_tick_ns());
+    ENABLE();
+}
+
+/** @brief A periodic job with a fixed execution time.
+ */
+void worker(int n)
+{
+    if (stop)
+        return;
+    RPI_WaitMicroSeconds(BENCH_WORK_US);
+}
+
+/** @brief Runs one configuration and reports its latency distribution.
+ * @param sync releases all threads together with the same period,
+ * otherwise the periods are 2, 3, 4, ... ticks
+ */
+static void run(int policy, const char *name, int nthreads, bool sync)
+{
+    char label[16];
+    uint64_t start = RPI_GetTimeMicroSeconds();
+
+    set_scheduler(policy);
+    stop = false;
+    latency_reset();
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        // Implicit deadlines
+        uint64_t period = sync ? BENCH_SYNC_PERIOD : (i + 2) * BENCH_TICK_US;
+        spawnWithDeadline(worker, i, start + period, period);
+    }
+
+    while (latency_count() < BENCH_SAMPLES)
+        no_operation();
+
+    stop = true;
+    for (int retired = 0; retired < nthreads;)
+        retired += retire_periodic_tasks();
+
+    snprintf(label, sizeof(label), "%s%s/%d", name, sync ? "-sync" : "", nthreads);
+    latency_report(label);
+}
+
+int main()
+{
+    uart_init();
+    print2uart("\nTinyThreads IRQ-to-dispatch latency\n");
+
+    initTimerInterrupts();
+
+    for (int n = 1; n <= BENCH_MAX_WORKERS; n++)
+        run(SCHED_RR, "RR", n, false);
+    for (int n = 1; n <= BENCH_MAX_WORKERS; n++)
+        run(SCHED_RM, "RM", n, false);
+    for (int n = 1; n <= BENCH_MAX_WORKERS; n++)
+        run(SCHED_EDF, "EDF", n, false);
+    for (int n = 1; n <= BENCH_MAX_WORKERS; n++)
+        run(SCHED_EDF, "EDF", n, true);
+
+    if (kernel_tick_fiq(1) == 0)
+    {
+        for (int n = 1; n <= BENCH_MAX_WORKERS; n++)
+            run(SCHED_EDF, "EDF-fiq", n, false);
+        kernel_tick_fiq(0);
+    }
+    else
+        print2uart("FIQ taken, EDF-fiq runs skipped\n");
+
+    print2uart("done\n");
+    while (1)
+        no_operation();
+}
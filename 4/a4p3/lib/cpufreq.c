@@ -0,0 +1,48 @@
+/*
+ * ARM clock of the Raspberry Pi 3.
+ */
+
+#include <stdint.h>
+
+#include "cpufreq.h"
+#include "rpi-mailbox.h"
+
+/** @brief Sets the ARM clock, clamped to the range the firmware allows.
+ * The core clock, and with it the UART and the ARM timer, is unaffected.
+ * @return the rate that was set in Hz, or 0 if the firmware did not answer
+ */
+uint32_t cpufreq_set(uint32_t hz)
+{
+	uint32_t min = RPI_GetMinClockRate(RPI_CLOCK_ARM);
+	uint32_t max = RPI_GetMaxClockRate(RPI_CLOCK_ARM);
+
+	if (max != 0 && hz > max)
+		hz = max;
+	if (hz < min)
+		hz = min;
+	return RPI_SetClockRate(RPI_CLOCK_ARM, hz);
+}
+
+/** @brief Sets the ARM clock to the highest rate the firmware allows.
+ * @return the rate that was set in Hz, or 0 if the firmware did not answer
+ */
+uint32_t cpufreq_set_max(void)
+{
+	uint32_t max = RPI_GetMaxClockRate(RPI_CLOCK_ARM);
+
+	return max != 0 ? RPI_SetClockRate(RPI_CLOCK_ARM, max) : 0;
+}
+
+/** @return the current ARM clock in Hz, or 0 if the firmware did not answer
+ */
+uint32_t cpufreq_get(void)
+{
+	return RPI_GetClockRate(RPI_CLOCK_ARM);
+}
+
+/** @brief Runs before main, so that all code runs at full speed by default.
+ */
+__attribute__((constructor)) static void cpufreq_boost(void)
+{
+	cpufreq_set_max();
+}
@@ -0,0 +1,19 @@
+/*
+ * ARM clock of the Raspberry Pi 3.
+ * The firmware boots the ARM cores at its idle clock, usually well below
+ * the maximum. A constructor raises the clock to the highest rate the
+ * firmware allows before main runs, which the firmware itself lowers while
+ * the SoC is too hot or under-powered. Applications that prefer a cooler
+ * or more predictable processor lower it again with cpufreq_set().
+ */
+
+#ifndef _CPUFREQ_H
+#define _CPUFREQ_H
+
+#include <stdint.h>
+
+uint32_t cpufreq_set(uint32_t hz);
+uint32_t cpufreq_set_max(void);
+uint32_t cpufreq_get(void);
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ * Time-triggered cyclic executive for TinyThreads.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cyclic.h"
+#include "tinythreads.h"
+#include "rpi-interrupts.h"
+#include "rpi-systimer.h"
+
+static const tt_schedule *table = NULL;
+// @brief Absolute start of the next minor frame in microseconds.
+static uint64_t next_frame;
+// @brief Minor frame the executor runs next.
+static int frame;
+// @brief Set while the executor runs the jobs of a frame.
+static volatile int busy;
+static int overruns = 0;
+
+// @brief The frame executor waits here for the start of the next frame.
+static thread frameQ = NULL;
+static int started = 0;
+
+/** @brief Runs the jobs of the current minor frame in table order, then
+ * waits for the next frame.
+ */
+static void executor(int arg)
+{
+	irqflags_t flags = irqsave();
+
+	while (1)
+	{
+		busy = 0;
+		wait_on(&frameQ, NO_DEADLINE);
+
+		const tt_schedule *s = table;
+		int f = frame;
+
+		irqrestore(flags);
+		for (int j = s->frame_start[f]; j < s->frame_start[f + 1]; j++)
+		{
+			const tt_task *t = &s->tasks[s->jobs[j]];
+
+			t->function(t->arg);
+		}
+		flags = irqsave();
+	}
+}
+
+/** @brief Starts the frame executor at the next frame boundary. Called by
+ * scheduler() under SCHED_TT, with IRQs masked, at the latest at the
+ * frame start returned by cyclic_next_frame().
+ * A frame whose start finds the previous frame still running is skipped
+ * and counted as an overrun, as is every frame whose start passed while
+ * IRQs were masked for longer than a frame. Only the latest frame that has
+ * started is run.
+ */
+void cyclic_tick(void)
+{
+	uint64_t now = RPI_GetTimeMicroSeconds();
+
+	if (table == NULL || now < next_frame)
+		return;
+
+	next_frame += table->minor_us;
+	frame = frame + 1 < table->nframes ? frame + 1 : 0;
+	while (now >= next_frame)
+	{
+		next_frame += table->minor_us;
+		frame = frame + 1 < table->nframes ? frame + 1 : 0;
+		overruns++;
+	}
+	if (busy)
+	{
+		overruns++;
+	}
+	else
+	{
+		busy = 1;
+		wake_one(&frameQ);
+	}
+}
+
+/** @return the absolute start of the next minor frame in microseconds,
+ * NO_DEADLINE if no table is running. Must be called with IRQs masked.
+ */
+uint64_t cyclic_next_frame(void)
+{
+	return table != NULL ? next_frame : NO_DEADLINE;
+}
+
+/** @brief Switches to the time-triggered policy.
+ * @param s is the schedule table, see tools/ttgen
+ * @param start is the absolute time of the first major frame in
+ * microseconds
+ */
+void cyclic_start(const tt_schedule *s, uint64_t start)
+{
+	irqflags_t flags = irqsave();
+
+	table = s;
+	frame = -1;
+	next_frame = start;
+	overruns = 0;
+	if (!started)
+	{
+		spawnService(executor, 0);
+		busy = 1; // Until the executor is waiting for the first frame
+		started = 1;
+	}
+	set_scheduler(SCHED_TT);
+
+	irqrestore(flags);
+}
+
+/** @return the number of minor frames skipped because the previous frame
+ * had not finished in time
+ */
+int cyclic_overruns(void)
+{
+	return overruns;
+}
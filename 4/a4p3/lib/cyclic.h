@@ -0,0 +1,35 @@
+/*
+ * Time-triggered cyclic executive for TinyThreads.
+ * A schedule table, generated offline by tools/ttgen, lists for every
+ * minor frame of the major frame the jobs to run, in order. Under
+ * SCHED_TT the kernel's wakeup timer runs the scheduler at every minor
+ * frame start, independently of the tick period. It advances the frame
+ * index and wakes the frame executor thread, which runs the jobs of the
+ * frame back to back. Threads spawned as usual run EDF in the slack left
+ * by the table.
+ */
+
+#ifndef _CYCLIC_H
+#define _CYCLIC_H
+
+#include <stdint.h>
+
+typedef struct {
+    void (*function)(int);
+    int arg;
+} tt_task;
+
+typedef struct {
+    uint32_t minor_us;              // Length of a minor frame in microseconds
+    uint16_t nframes;               // Minor frames per major frame
+    const uint16_t *frame_start;    // Jobs of frame i: jobs[frame_start[i] .. frame_start[i + 1] - 1]
+    const uint8_t *jobs;            // Indices into tasks
+    const tt_task *tasks;
+} tt_schedule;
+
+void cyclic_start(const tt_schedule *s, uint64_t start);
+void cyclic_tick(void);
+uint64_t cyclic_next_frame(void);
+int cyclic_overruns(void);
+
+#endif
@@ -0,0 +1,107 @@
+/*
+ * Event flag groups for TinyThreads.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "event.h"
+#include "tinythreads.h"
+#include "rpi-interrupts.h"
+
+// @brief What a blocked thread waits for, lives on the waiting thread's stack.
+struct event_waiter
+{
+	uint32_t mask;
+	int mode;
+	uint32_t result; // Flags that satisfied the wait, 0 on timeout
+};
+
+// @brief Passed to match_waiter() by event_set().
+struct event_setter
+{
+	event *e;
+	uint32_t raised; // Flags when event_set() was called, seen by all waiters
+};
+
+static int satisfied(uint32_t flags, uint32_t mask, int mode)
+{
+	if (mode & EVENT_ALL)
+		return (flags & mask) == mask;
+	return (flags & mask) != 0;
+}
+
+static int match_waiter(void *data, void *arg)
+{
+	struct event_waiter *w = data;
+	struct event_setter *s = arg;
+
+	if (!satisfied(s->raised, w->mask, w->mode))
+		return 0;
+
+	// Cleared before any woken thread runs, which may be right after the wake-up
+	w->result = s->raised & w->mask;
+	if (w->mode & EVENT_CLEAR)
+		s->e->flags &= ~w->mask;
+	return 1;
+}
+
+/** @brief Waits until the flags in mask are raised, any or all of them
+ * depending on mode.
+ * @param mode is EVENT_ANY or EVENT_ALL, optionally or'ed with EVENT_CLEAR
+ * @param timeout is an absolute time in microseconds, NO_DEADLINE or NO_WAIT
+ * @return the awaited flags that were raised, 0 if the timeout expired
+ */
+uint32_t event_wait(event *e, uint32_t mask, int mode, uint64_t timeout)
+{
+	struct event_waiter w = {mask, mode, 0};
+	irqflags_t flags = irqsave();
+
+	if (satisfied(e->flags, mask, mode))
+	{
+		w.result = e->flags & mask;
+		if (mode & EVENT_CLEAR)
+			e->flags &= ~mask;
+	}
+	else
+	{
+		// On success the result is filled in by event_set()
+		wait_on_data(&e->waitQ, timeout, &w);
+	}
+
+	irqrestore(flags);
+	return w.result;
+}
+
+/** @brief Raises flags and wakes up the threads whose wait is satisfied.
+ * Only the threads waiting on this group are visited. May be called from
+ * interrupt handlers.
+ */
+void event_set(event *e, uint32_t bits)
+{
+	irqflags_t flags = irqsave();
+
+	e->flags |= bits;
+	if (e->waitQ != NULL)
+	{
+		struct event_setter s = {e, e->flags};
+
+		wake_matching(&e->waitQ, match_waiter, &s);
+	}
+
+	irqrestore(flags);
+}
+
+/** @brief Lowers flags. May be called from interrupt handlers.
+ */
+void event_clear(event *e, uint32_t bits)
+{
+	irqflags_t flags = irqsave();
+	e->flags &= ~bits;
+	irqrestore(flags);
+}
+
+uint32_t event_get(event *e)
+{
+	return e->flags;
+}
@@ -0,0 +1,32 @@
+/*
+ * Event flag groups for TinyThreads.
+ * A thread can wait until any or all of a set of flags in a group are
+ * raised by other threads or by interrupt handlers.
+ */
+
+#ifndef _EVENT_H
+#define _EVENT_H
+
+#include <stdint.h>
+
+#include "tinythreads.h"
+
+#define EVENT_INIT {0, 0}
+
+/* Modes of event_wait(), EVENT_CLEAR can be or'ed with the others */
+#define EVENT_ANY       0           // Wait until any flag of the mask is raised
+#define EVENT_ALL       (1 << 0)    // Wait until all flags of the mask are raised
+#define EVENT_CLEAR     (1 << 1)    // Clear the awaited flags when woken up
+
+struct event_block {
+    uint32_t flags;
+    thread waitQ;
+};
+typedef struct event_block event;
+
+uint32_t event_wait(event *e, uint32_t mask, int mode, uint64_t timeout);
+void event_set(event *e, uint32_t bits);
+void event_clear(event *e, uint32_t bits);
+uint32_t event_get(event *e);
+
+#endif
@@ -0,0 +1,23 @@
+/*
+ * Placement of the interrupt and scheduling hot path.
+ *
+ * Functions marked __fastcode are linked into the .fast section, which
+ * follows the vector table at 0x8000. The IRQ path and the scheduler
+ * thereby share a few consecutive instruction cache lines instead of
+ * being spread over the image in link order. Data is not placed: with the
+ * MMU off, data accesses are not cached.
+ *
+ * Build with -DNO_FASTCODE (make FAST=0) to link everything in place, e.g.,
+ * to compare the interrupt-path timing with make MAINFILE=latbench.
+ */
+
+#ifndef _FASTCODE_H
+#define _FASTCODE_H
+
+#ifdef NO_FASTCODE
+#define __fastcode
+#else
+#define __fastcode __attribute__((section(".fast.text")))
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * High-resolution one-shot timers on the system timer compare channels.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hrtimer.h"
+#include "rpi-interrupts.h"
+#include "rpi-systimer.h"
+#include "fastcode.h"
+
+// @brief Active timers, sorted by expiry.
+static hrtimer * pending = NULL;
+static int enabled = 0;
+
+/** @brief Programs a compare channel for a timer, or parks it about 71
+ * minutes ahead if there is none. The compare registers only hold the
+ * low 32 bits, timers further ahead are reached in steps.
+ */
+static void program(volatile uint32_t *compare, hrtimer *t)
+{
+	rpi_sys_timer_t *st = RPI_GetSystemTimer();
+	uint64_t now = RPI_GetTimeMicroSeconds();
+	uint64_t delta;
+	uint32_t cmp;
+
+	if (t == NULL)
+	{
+		*compare = (uint32_t)now - 1;
+		return;
+	}
+
+	delta = t->expiry > now ? t->expiry - now : 0;
+	if (delta < HRTIMER_MIN_US)
+		delta = HRTIMER_MIN_US;
+	if (delta > 0x7FFFFFFF)
+		delta = 0x7FFFFFFF;
+	cmp = (uint32_t)now + (uint32_t)delta;
+	*compare = cmp;
+
+	// Delayed between reading the counter and writing the compare value
+	while ((int32_t)(st->counter_lo - cmp) >= 0)
+	{
+		cmp = st->counter_lo + HRTIMER_MIN_US;
+		*compare = cmp;
+	}
+}
+
+static void hrtimer_irq(void *arg);
+
+static void rearm(void)
+{
+	rpi_sys_timer_t *st = RPI_GetSystemTimer();
+
+	program(&st->compare1, pending);
+	program(&st->compare3, pending != NULL ? pending->next : NULL);
+}
+
+static void unlink_timer(hrtimer *t)
+{
+	hrtimer **q = &pending;
+
+	while (*q != NULL && *q != t)
+		q = &(*q)->next;
+	if (*q == t)
+		*q = t->next;
+	t->active = 0;
+}
+
+/** @brief Starts a timer, or restarts it if it is active.
+ * May be called from interrupt handlers and from callbacks.
+ * @param expiry is an absolute time in microseconds
+ * @param callback is called in interrupt context with arg
+ */
+void hrtimer_start(hrtimer *t, uint64_t expiry, void (*callback)(int), int arg)
+{
+	irqflags_t flags = irqsave();
+	hrtimer **q = &pending;
+
+	if (!enabled)
+	{
+		RPI_GetSystemTimer()->control_status = RPI_SYSTIMER_M1 | RPI_SYSTIMER_M3;
+		irq_register(IRQ_SYSTIMER_1, hrtimer_irq, NULL);
+		irq_register(IRQ_SYSTIMER_3, hrtimer_irq, NULL);
+		enabled = 1;
+	}
+
+	if (t->active)
+		unlink_timer(t);
+	t->expiry = expiry;
+	t->callback = callback;
+	t->arg = arg;
+	t->active = 1;
+	while (*q != NULL && (*q)->expiry <= expiry)
+		q = &(*q)->next;
+	t->next = *q;
+	*q = t;
+
+	// Only the first two timers are in the compare registers
+	if (pending == t || pending->next == t)
+		rearm();
+
+	irqrestore(flags);
+}
+
+/** @brief Stops a timer if it is active.
+ */
+void hrtimer_cancel(hrtimer *t)
+{
+	irqflags_t flags = irqsave();
+
+	if (t->active)
+	{
+		int armed = pending == t || pending->next == t;
+
+		unlink_timer(t);
+		if (armed)
+			rearm();
+	}
+
+	irqrestore(flags);
+}
+
+/** @brief Runs the callbacks of all expired timers. The handler of both
+ * compare channels, returns at once if the other channel already did the
+ * work.
+ */
+static void __fastcode hrtimer_irq(void *arg)
+{
+	rpi_sys_timer_t *st = RPI_GetSystemTimer();
+	uint32_t matched = st->control_status & (RPI_SYSTIMER_M1 | RPI_SYSTIMER_M3);
+
+	if (matched == 0)
+		return;
+
+	// Cleared first, so a match while the callbacks run raises a new IRQ
+	st->control_status = matched;
+	while (pending != NULL && pending->expiry <= RPI_GetTimeMicroSeconds())
+	{
+		hrtimer *t = pending;
+
+		pending = t->next;
+		t->active = 0;
+		t->callback(t->arg);
+	}
+	rearm();
+}
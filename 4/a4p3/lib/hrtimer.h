@@ -0,0 +1,33 @@
+/*
+ * High-resolution one-shot timers on the system timer compare channels.
+ * Any number of timers are kept in a list sorted by expiry; the earliest
+ * is programmed into compare channel 1 and the next one into channel 3,
+ * so expiries closer together than the interrupt latency still both
+ * raise an interrupt. Callbacks run in interrupt context.
+ */
+
+#ifndef _HRTIMER_H
+#define _HRTIMER_H
+
+#include <stdint.h>
+
+/* Shortest delay programmed into a compare register, so that the
+   counter cannot pass the compare value before it is written */
+#define HRTIMER_MIN_US 2
+
+typedef struct hrtimer_block hrtimer;
+
+struct hrtimer_block {
+    hrtimer *next;
+    uint64_t expiry;            // Absolute time in microseconds
+    void (*callback)(int);
+    int arg;
+    int active;
+};
+
+#define HRTIMER_INIT {0, 0, 0, 0, 0}
+
+void hrtimer_start(hrtimer *t, uint64_t expiry, void (*callback)(int), int arg);
+void hrtimer_cancel(hrtimer *t);
+
+#endif
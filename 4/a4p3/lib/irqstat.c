@@ -0,0 +1,130 @@
+/*
+ * Per-source interrupt statistics.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "irqstat.h"
+#include "rpi-interrupts.h"
+#include "rpi-systimer.h"
+#include "fastcode.h"
+#include "uart.h"
+
+struct irqstat {
+	uint32_t latency[IRQSTAT_BUCKETS];
+	uint32_t duration[IRQSTAT_BUCKETS];
+	uint32_t count;
+};
+
+static struct irqstat stats[IRQ_NSOURCES];
+
+static uint32_t systimer1_expiry(void)
+{
+	return RPI_GetSystemTimer()->compare1;
+}
+
+static uint32_t systimer3_expiry(void)
+{
+	return RPI_GetSystemTimer()->compare3;
+}
+
+// @brief Sources whose expiry is known, see irqstat_set_expiry().
+static irqstat_expiry_t expiry_of[IRQ_NSOURCES] = {
+	[IRQ_SYSTIMER_1] = systimer1_expiry,
+	[IRQ_SYSTIMER_3] = systimer3_expiry,
+};
+
+/** @return the bucket of a value, the number of significant bits
+ */
+static int __fastcode bucket(uint32_t us)
+{
+	int b = us == 0 ? 0 : 32 - __builtin_clz(us);
+
+	return b < IRQSTAT_BUCKETS ? b : IRQSTAT_BUCKETS - 1;
+}
+
+/** @brief Tells how to find out when a timer source fired, so that its
+ * entry latency is recorded. The system timer channels are known already.
+ * @param expiry is NULL for sources that are not timers
+ */
+void irqstat_set_expiry(int source, irqstat_expiry_t expiry)
+{
+	if (source >= 0 && source < IRQ_NSOURCES)
+		expiry_of[source] = expiry;
+}
+
+/** @brief Called by interrupt_vector() right before the handler of a source.
+ * @return the entry time, for irqstat_exit()
+ */
+uint32_t __fastcode irqstat_enter(int source)
+{
+	uint32_t entry = RPI_GetSystemTimer()->counter_lo;
+
+	if (expiry_of[source] != NULL)
+	{
+		int32_t latency = (int32_t)(entry - expiry_of[source]());
+
+		// The expiry is in the future if the timer was rearmed early
+		if (latency >= 0)
+			stats[source].latency[bucket(latency)]++;
+	}
+	return entry;
+}
+
+/** @brief Called by interrupt_vector() right after the handler of a source.
+ */
+void __fastcode irqstat_exit(int source, uint32_t entry)
+{
+	stats[source].duration[bucket(RPI_GetSystemTimer()->counter_lo - entry)]++;
+	stats[source].count++;
+}
+
+void irqstat_reset(void)
+{
+	irqflags_t flags = irqsave();
+
+	for (int i = 0; i < IRQ_NSOURCES; i++)
+		stats[i] = (struct irqstat){0};
+
+	irqrestore(flags);
+}
+
+static void print_histogram(const char *what, const uint32_t *h)
+{
+	print2uart("  %-8s", what);
+	for (int b = 0; b < IRQSTAT_BUCKETS; b++)
+	{
+		if (h[b] == 0)
+			continue;
+		if (b < IRQSTAT_BUCKETS - 1)
+			print2uart(" <%u:%u", 1u << b, h[b]);
+		else
+			print2uart(" >=%u:%u", 1u << (b - 1), h[b]);
+	}
+	print2uart(" us\n");
+}
+
+/** @brief Prints the histograms of all sources that were taken via UART.
+ * Each source is copied with IRQs masked, so the report may be printed
+ * while interrupts keep coming in.
+ */
+void irqstat_report(void)
+{
+	print2uart("IRQ statistics\n");
+	for (int i = 0; i < IRQ_NSOURCES; i++)
+	{
+		struct irqstat s;
+		irqflags_t flags = irqsave();
+
+		s = stats[i];
+		irqrestore(flags);
+
+		if (s.count == 0)
+			continue;
+		print2uart("IRQ %2d n=%u\n", i, s.count);
+		if (expiry_of[i] != NULL)
+			print_histogram("latency", s.latency);
+		print_histogram("handler", s.duration);
+	}
+}
@@ -0,0 +1,28 @@
+/*
+ * Per-source interrupt statistics.
+ * interrupt_vector() records, for every handler it calls, the entry latency,
+ * i.e., the time from the expiry of the timer behind the source to the
+ * call of the handler, and the time spent in the handler. Both go into
+ * log2 histograms in microseconds that can be printed at any time.
+ */
+
+#ifndef _IRQSTAT_H
+#define _IRQSTAT_H
+
+#include <stdint.h>
+
+/* Buckets of a histogram: 0, 1, 2-3, 4-7, ..., 512-1023 and >= 1024 us */
+#define IRQSTAT_BUCKETS 12
+
+/* Returns the low word of the system timer at which the source fired.
+   Called right before the handler, which may rearm the timer. */
+typedef uint32_t (*irqstat_expiry_t)(void);
+
+void irqstat_set_expiry(int source, irqstat_expiry_t expiry);
+uint32_t irqstat_enter(int source);
+void irqstat_exit(int source, uint32_t entry);
+
+void irqstat_reset(void);
+void irqstat_report(void);
+
+#endif
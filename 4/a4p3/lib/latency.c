@@ -0,0 +1,99 @@
+/*
+ * Interrupt-to-dispatch latency measurement for TinyThreads.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "latency.h"
+#include "rpi-systimer.h"
+#include "uart.h"
+
+// @brief Latencies in microseconds, one per IRQ that ended in a dispatch.
+static uint32_t samples[LATENCY_MAX_SAMPLES];
+static volatile int nsamples = 0;
+
+// @brief System timer value when the last IRQ was taken.
+static volatile uint32_t irq_stamp;
+// @brief Set between the IRQ and the first thread resume that follows it.
+static volatile int irq_pending = 0;
+
+/** @brief Discards all collected samples.
+ */
+void latency_reset(void)
+{
+	irq_pending = 0;
+	nsamples = 0;
+}
+
+/** @brief Called first thing in the IRQ and FIQ handlers. An IRQ raised by
+ * an FIQ handler keeps the stamp of the FIQ.
+ */
+void latency_irq_stamp(void)
+{
+	if (!irq_pending)
+	{
+		irq_stamp = RPI_GetSystemTimer()->counter_lo;
+		irq_pending = 1;
+	}
+}
+
+/** @brief Called when the IRQ handler returns to the interrupted thread,
+ * i.e., no dispatch took place.
+ */
+void latency_irq_done(void)
+{
+	irq_pending = 0;
+}
+
+/** @brief Called whenever a thread resumes or starts after a dispatch.
+ * Only the first resume after an IRQ produces a sample.
+ */
+void latency_resume_stamp(void)
+{
+	if (irq_pending)
+	{
+		uint32_t now = RPI_GetSystemTimer()->counter_lo;
+
+		irq_pending = 0;
+		if (nsamples < LATENCY_MAX_SAMPLES)
+			samples[nsamples++] = now - irq_stamp;
+	}
+}
+
+int latency_count(void)
+{
+	return nsamples;
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/** @brief Prints min/avg/max and percentiles of the collected samples via UART.
+ * The samples are sorted in place, so measurement must be stopped first.
+ */
+void latency_report(const char *label)
+{
+	int n = nsamples;
+	uint64_t sum = 0;
+
+	if (n == 0)
+	{
+		print2uart("%-12s n=0\n", label);
+		return;
+	}
+
+	qsort(samples, n, sizeof(samples[0]), compare_samples);
+	for (int i = 0; i < n; i++)
+		sum += samples[i];
+
+	print2uart("%-12s n=%4d min=%4u avg=%4u p50=%4u p90=%4u p99=%4u max=%4u us\n",
+			   label, n, samples[0], (uint32_t)(sum / n),
+			   samples[n / 2], samples[(n * 90) / 100], samples[(n * 99) / 100],
+			   samples[n - 1]);
+}
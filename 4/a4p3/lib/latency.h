@@ -0,0 +1,34 @@
+/*
+ * Interrupt-to-dispatch latency measurement for TinyThreads.
+ * The system timer is stamped when the ARM timer IRQ is taken and again
+ * when the thread selected by the scheduler resumes execution.
+ */
+
+#ifndef _LATENCY_H
+#define _LATENCY_H
+
+#include <stdint.h>
+
+#define LATENCY_MAX_SAMPLES 1024
+
+/* The hooks compile to nothing unless the image is built with
+   -DLATENCY_BENCH, so the regular assignments pay no overhead. */
+#ifdef LATENCY_BENCH
+#define LATENCY_IRQ_STAMP() latency_irq_stamp()
+#define LATENCY_IRQ_DONE() latency_irq_done()
+#define LATENCY_RESUME_STAMP() latency_resume_stamp()
+#else
+#define LATENCY_IRQ_STAMP() do { } while (0)
+#define LATENCY_IRQ_DONE() do { } while (0)
+#define LATENCY_RESUME_STAMP() do { } while (0)
+#endif
+
+void latency_reset(void);
+void latency_irq_stamp(void);
+void latency_irq_done(void);
+void latency_resume_stamp(void);
+
+int latency_count(void);
+void latency_report(const char *label);
+
+#endif
@@ -6,6 +6,12 @@
 #include "rpi3.h"
 #include "rpi-systimer.h"
 #include "rpi-gpio.h"
+#include "timer.h"
+
+// @brief Current state of the LED, 1 when on.
+static int led_state = 0;
+// @brief Timer that toggles the LED while blinking, -1 when not blinking.
+static int blink_timer = -1;
 
 
 void led_init(){
@@ -22,6 +28,7 @@ void led_init(){
 
 
 void led_on(){
+	led_state = 1;
 	
 	/* Set the GPIO16 output high ( Turn OK LED off )*/
 	GPIO->GPSET0 |= (1 << 16);
@@ -35,6 +42,7 @@ void led_on(){
 }
 
 void led_off(){
+	led_state = 0;
 	/* Set the GPIO16 output high ( Turn OK LED off )*/
 	GPIO->GPCLR0 |= (1 << 16);
 
@@ -46,11 +54,26 @@ void led_off(){
 	#endif	
 }
 
-void led_blink(){
+static void led_blink_tick(int arg){
+	led_toggle();
+}
 
+/** @brief Blinks the LED from the software timer thread.
+ * @param period_us is the time between two toggles, 0 stops blinking
+ */
+void led_blink(uint32_t period_us){
+	if (blink_timer >= 0) {
+		timer_stop(blink_timer);
+		blink_timer = -1;
+	}
+	if (period_us != 0)
+		blink_timer = timer_start(led_blink_tick, 0, period_us, period_us);
 }
 
 void led_toggle() {
-
+	if (led_state)
+		led_off();
+	else
+		led_on();
 }
 
@@ -5,6 +5,8 @@
 #ifndef LED_H
 #define LED_H
 
+#include <stdint.h>
+
 // Similar to rpi-gpio.h
 #define LEDHH_GPFSEL      GPFSEL1
 #define LEDHH_GPFBIT      18
@@ -19,7 +21,7 @@
 
 
 void led_init();
-void led_blink();
+void led_blink(uint32_t period_us);
 void led_on();
 void led_off();
 void led_toggle();
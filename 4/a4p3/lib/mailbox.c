@@ -0,0 +1,119 @@
+/*
+ * Zero-copy mailboxes for TinyThreads.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mailbox.h"
+#include "tinythreads.h"
+#include "rpi-interrupts.h"
+
+/** @brief Builds the free list of a message pool. Free buffers hold the
+ * link to the next free buffer in their first word.
+ * @param storage holds nbufs buffers of bufsize bytes each
+ * @param bufsize must be a multiple of 4 and at least sizeof(void *)
+ */
+void msgpool_init(msgpool *p, void *storage, size_t bufsize, int nbufs)
+{
+	char *buf = storage;
+
+	p->freelist = NULL;
+	p->waitQ = NULL;
+	for (int i = nbufs - 1; i >= 0; i--)
+	{
+		*(void **)(buf + i * bufsize) = p->freelist;
+		p->freelist = buf + i * bufsize;
+	}
+}
+
+/** @brief Takes a buffer from the pool, waiting until one is returned if
+ * the pool is empty. With timeout NO_WAIT it may be called from interrupt
+ * handlers.
+ * @param timeout is an absolute time in microseconds, NO_DEADLINE or NO_WAIT
+ * @return the buffer, or NULL if the timeout expired
+ */
+void *msg_alloc(msgpool *p, uint64_t timeout)
+{
+	void *buf = NULL;
+	irqflags_t flags = irqsave();
+
+	while (p->freelist == NULL && wait_on(&p->waitQ, timeout) == WAIT_OK)
+		;
+	if (p->freelist != NULL)
+	{
+		buf = p->freelist;
+		p->freelist = *(void **)buf;
+	}
+
+	irqrestore(flags);
+	return buf;
+}
+
+/** @brief Returns a buffer to its pool. May be called from interrupt handlers.
+ */
+void msg_free(msgpool *p, void *buf)
+{
+	irqflags_t flags = irqsave();
+
+	*(void **)buf = p->freelist;
+	p->freelist = buf;
+	wake_one(&p->waitQ);
+
+	irqrestore(flags);
+}
+
+/** @brief Queues a message, waiting for a free slot if the mailbox is full.
+ * Ownership of the buffer passes to the receiver.
+ * @param timeout is an absolute time in microseconds, NO_DEADLINE or NO_WAIT
+ * @return WAIT_OK, or WAIT_TIMEOUT if the message was not sent
+ */
+int mbox_send(mailbox *mb, void *msg, uint64_t timeout)
+{
+	int result = WAIT_OK;
+	irqflags_t flags = irqsave();
+
+	while (mb->count == mb->size && result == WAIT_OK)
+		result = wait_on(&mb->sendQ, timeout);
+	if (result == WAIT_OK)
+	{
+		mb->slots[(mb->head + mb->count) % mb->size] = msg;
+		mb->count++;
+		wake_one(&mb->recvQ);
+	}
+
+	irqrestore(flags);
+	return result;
+}
+
+/** @brief Sends a message from an interrupt handler, never blocks.
+ * @return WAIT_OK, or WAIT_TIMEOUT if the mailbox is full
+ */
+int mbox_send_isr(mailbox *mb, void *msg)
+{
+	return mbox_send(mb, msg, NO_WAIT);
+}
+
+/** @brief Takes the oldest message, waiting for one if the mailbox is empty.
+ * @param msg receives the pointer to the message buffer
+ * @param timeout is an absolute time in microseconds, NO_DEADLINE or NO_WAIT
+ * @return WAIT_OK, or WAIT_TIMEOUT if no message arrived in time
+ */
+int mbox_recv(mailbox *mb, void **msg, uint64_t timeout)
+{
+	int result = WAIT_OK;
+	irqflags_t flags = irqsave();
+
+	while (mb->count == 0 && result == WAIT_OK)
+		result = wait_on(&mb->recvQ, timeout);
+	if (result == WAIT_OK)
+	{
+		*msg = mb->slots[mb->head];
+		mb->head = (mb->head + 1) % mb->size;
+		mb->count--;
+		wake_one(&mb->sendQ);
+	}
+
+	irqrestore(flags);
+	return result;
+}
@@ -0,0 +1,54 @@
+/*
+ * Zero-copy mailboxes for TinyThreads.
+ * Messages are pointers to buffers taken from a fixed-size message pool,
+ * so sending a message hands the buffer over to the receiver without
+ * copying. The receiver returns the buffer with msg_free().
+ */
+
+#ifndef _MAILBOX_H
+#define _MAILBOX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tinythreads.h"
+
+/* Initializes a mailbox that queues up to the number of elements of the
+   array 'slots', e.g., void *slots[8]; mailbox mb = MAILBOX_INIT(slots); */
+#define MAILBOX_INIT(slots) {(slots), sizeof(slots) / sizeof((slots)[0]), 0, 0, 0, 0}
+
+struct mailbox_block {
+    void **slots;
+    int size;
+    int head;
+    int count;
+    thread sendQ;   // Senders waiting for a free slot
+    thread recvQ;   // Receivers waiting for a message
+};
+typedef struct mailbox_block mailbox;
+
+struct msgpool_block {
+    void *freelist;
+    thread waitQ;   // Threads waiting for a free buffer
+};
+typedef struct msgpool_block msgpool;
+
+/* Declares typed wrappers name_send(), name_recv() and name_send_isr()
+   for a mailbox that carries pointers to 'type'. */
+#define MAILBOX_TYPE(name, type) \
+static inline int name##_send(mailbox *mb, type *msg, uint64_t timeout) \
+    { return mbox_send(mb, msg, timeout); } \
+static inline int name##_recv(mailbox *mb, type **msg, uint64_t timeout) \
+    { return mbox_recv(mb, (void **)msg, timeout); } \
+static inline int name##_send_isr(mailbox *mb, type *msg) \
+    { return mbox_send_isr(mb, msg); }
+
+void msgpool_init(msgpool *p, void *storage, size_t bufsize, int nbufs);
+void *msg_alloc(msgpool *p, uint64_t timeout);
+void msg_free(msgpool *p, void *buf);
+
+int mbox_send(mailbox *mb, void *msg, uint64_t timeout);
+int mbox_recv(mailbox *mb, void **msg, uint64_t timeout);
+int mbox_send_isr(mailbox *mb, void *msg);
+
+#endif
@@ -7,10 +7,25 @@
 #include <stdint.h>
 #include <string.h>
 #include "rpi-gpio.h"
+#include "rpi-interrupts.h"
+#include "rpi-systimer.h"
+#include "hrtimer.h"
+#include "mailbox.h"
 #include "piface.h"
 
 int cnt;
 
+// @brief Debounced state of port A, kept up to date by the button interrupt.
+static volatile uint8_t buttons;
+// @brief System time of the first edge since the buttons were last quiet.
+static uint64_t first_edge;
+static hrtimer debounce_timer = HRTIMER_INIT;
+
+static piface_event event_storage[PIFACE_NEVENTS];
+static msgpool event_pool;
+static void *event_slots[PIFACE_NEVENTS];
+static mailbox events = MAILBOX_INIT(event_slots);
+
 /* Bit-Banging SPI Driver */
 static void spi_init(void)
 {
@@ -59,9 +74,12 @@ static void spi_byte(const uint8_t out, uint8_t *in)
 	return;
 }
 
+/* Each transfer masks IRQs, since the button interrupt handler reads
+   the MCP23S17 in between the LCD transfers of the threads */
 static uint8_t mcp_read(const uint8_t reg)
 {
 	uint8_t in;
+	irqflags_t flags = irqsave();
 
 	spi_start();
 	spi_byte(0x41, &in);
@@ -69,18 +87,22 @@ static uint8_t mcp_read(const uint8_t reg)
 	spi_byte(0x00, &in);
 	spi_stop();
 
+	irqrestore(flags);
 	return in;
 }
 
 static void mcp_write(const uint8_t reg, const uint8_t val)
 {
 	uint8_t in;
+	irqflags_t flags = irqsave();
 
 	spi_start();
 	spi_byte(0x40, &in);
 	spi_byte(reg, &in);
 	spi_byte(val, &in);
 	spi_stop();
+
+	irqrestore(flags);
 }
 
 static void mcp_init(void)
@@ -90,6 +112,65 @@ static void mcp_init(void)
 	mcp_write(MCP_GPPUA, 0xFF);
 	/* Port B: (DB4 .. DB7, /EN, R/W, RS, LED) */
 	mcp_write(MCP_IODIRB, 0x00);
+
+	/* INTA active low and push-pull, on any change of a button */
+	mcp_write(MCP_IOCON, 0x00);
+	mcp_write(MCP_INTCONA, 0x00);
+	mcp_write(MCP_GPINTENA, 0xFF);
+}
+
+/** @brief Reports the change of the buttons once they have been quiet for
+ * PIFACE_DEBOUNCE_US. Runs in interrupt context, events that do not fit
+ * into the queue are dropped.
+ */
+static void buttons_settled(int arg)
+{
+	uint8_t state = mcp_read(MCP_GPIOA);
+	uint8_t changed = state ^ buttons;
+	piface_event *ev;
+
+	if (changed == 0)
+		return;
+	buttons = state;
+
+	ev = msg_alloc(&event_pool, NO_WAIT);
+	if (ev == NULL)
+		return;
+	ev->time = first_edge;
+	ev->state = state;
+	ev->changed = changed;
+	if (mbox_send_isr(&events, ev) != WAIT_OK)
+		msg_free(&event_pool, ev);
+}
+
+/** @brief Handler of the falling edge of INTA. Reading INTCAPA releases
+ * INTA, so every further change gives a new edge, and each edge restarts
+ * the debounce time.
+ */
+static void buttons_irq(void *arg)
+{
+	uint64_t now = RPI_GetTimeMicroSeconds();
+
+	// Cleared before INTA is released, so no later edge is lost
+	RPI_GetGpio()->GPEDS0 = 1 << PIFACE_INT_GPIO;
+	mcp_read(MCP_INTCAPA);
+
+	if (!debounce_timer.active)
+		first_edge = now;
+	hrtimer_start(&debounce_timer, now + PIFACE_DEBOUNCE_US, buttons_settled, 0);
+}
+
+static void buttons_init(void)
+{
+	msgpool_init(&event_pool, event_storage, sizeof(piface_event), PIFACE_NEVENTS);
+
+	RPI_SetGpioInput(PIFACE_INT_GPIO);
+	RPI_GetGpio()->GPFEN0 |= 1 << PIFACE_INT_GPIO;
+	RPI_GetGpio()->GPEDS0 = 1 << PIFACE_INT_GPIO;
+
+	// Releases INTA, which may be low since power up
+	buttons = mcp_read(MCP_GPIOA);
+	irq_register(IRQ_GPIO_0, buttons_irq, NULL);
 }
 
 static uint8_t lcd_read_busy_flag_register()
@@ -179,12 +260,33 @@ __attribute__((constructor)) void piface_init(void)
 	spi_init();
 	mcp_init();
 	lcd_init();
+	buttons_init();
 	cnt = 0;
 }
 
+/** @brief Returns the debounced state of the buttons on port A without
+ * accessing the SPI bus.
+ */
 uint8_t piface_getc(void)
 {
-	return mcp_read(MCP_GPIOA);
+	return buttons;
+}
+
+/** @brief Takes the oldest button change, waiting for one if there is none.
+ * @param timeout is an absolute time in microseconds, NO_DEADLINE or NO_WAIT
+ * @return WAIT_OK, or WAIT_TIMEOUT if no button changed in time
+ */
+int piface_wait_event(piface_event *ev, uint64_t timeout)
+{
+	piface_event *e;
+	int result = mbox_recv(&events, (void **)&e, timeout);
+
+	if (result == WAIT_OK)
+	{
+		*ev = *e;
+		msg_free(&event_pool, e);
+	}
+	return result;
 }
 
 /** @brief Writes a character
@@ -40,6 +40,13 @@
 #define MCP_OLATA       0x14
 #define MCP_OLATB       0x15
 
+/* Pi GPIO wired to INTA of the MCP23S17, i.e., the buttons on port A */
+#define PIFACE_INT_GPIO     25
+/* Quiet time after the last edge before a button change is reported */
+#define PIFACE_DEBOUNCE_US  5000
+/* Button events buffered for piface_wait_event() */
+#define PIFACE_NEVENTS      16
+
 /* HD44780 Control Pins */
 #define LCD_DB4     (1 << 0)
 #define LCD_DB5     (1 << 1)
@@ -63,11 +70,21 @@
 
 static const uint8_t ROW_OFFSETS[] = {0, 0x40};
 
+/* A debounced change of the buttons */
+typedef struct {
+    uint64_t time;      // System time of the first edge of the change
+    uint8_t state;      // Port A after the change, as piface_getc() returns it
+    uint8_t changed;    // Bits of port A that changed
+} piface_event;
+
 void piface_init(void);
 void piface_putc(char c);
 void piface_puts(char s[]);
 void piface_clear();
 
+uint8_t piface_getc(void);
+int piface_wait_event(piface_event *ev, uint64_t timeout);
+
 void piface_set_cursor(uint8_t col, uint8_t row);
 void print_at_seg(int seg, int num);
 void printf_at_seg(int seg, const char* fmt, ...);
@@ -0,0 +1,156 @@
+/*
+ * Stackless protothread tasks for TinyThreads.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pt.h"
+#include "tinythreads.h"
+#include "rpi-interrupts.h"
+#include "rpi-systimer.h"
+
+// @brief Tasks ready to run, sorted by deadline.
+static pt_task *readyT = NULL;
+// @brief Tasks waiting for their release or the end of a sleep, sorted by wakeup.
+static pt_task *sleepT = NULL;
+
+// @brief The carrier thread waits here when no task is ready.
+static thread carrierQ = NULL;
+static int started = 0;
+// @brief The carrier thread, NULL until it first runs.
+static thread carrier_thread = NULL;
+// @brief Shortest period of the tasks, the carrier's priority under SCHED_RM.
+static uint64_t carrier_period = NO_DEADLINE;
+
+static void insert_ready(pt_task *t)
+{
+	pt_task **q = &readyT;
+
+	while (*q != NULL && (*q)->deadline <= t->deadline)
+		q = &(*q)->next;
+	t->next = *q;
+	*q = t;
+}
+
+static void insert_sleeping(pt_task *t)
+{
+	pt_task **q = &sleepT;
+
+	while (*q != NULL && (*q)->wakeup <= t->wakeup)
+		q = &(*q)->next;
+	t->next = *q;
+	*q = t;
+}
+
+/** @return the deadline of the task that wakes up the carrier thread next,
+ * which the carrier waits with, so that it is not behind other threads in
+ * readyQ once it is woken up
+ */
+static uint64_t next_deadline(void)
+{
+	return sleepT != NULL ? sleepT->deadline : NO_DEADLINE;
+}
+
+/** @brief Body of the carrier thread. Runs the ready tasks one step at a
+ * time, earliest deadline first, and sleeps until the next release when no
+ * task is ready.
+ */
+static void carrier(int arg)
+{
+	irqflags_t flags = irqsave();
+
+	// Tasks spawned before the carrier first ran may have a shorter period
+	carrier_thread = self();
+	set_thread_period(carrier_thread, carrier_period);
+
+	while (1)
+	{
+		uint64_t now = RPI_GetTimeMicroSeconds();
+
+		while (sleepT != NULL && sleepT->wakeup <= now)
+		{
+			pt_task *t = sleepT;
+
+			sleepT = t->next;
+			insert_ready(t);
+		}
+
+		if (readyT == NULL)
+		{
+			set_deadline(next_deadline());
+			wait_on(&carrierQ, sleepT != NULL ? sleepT->wakeup : NO_DEADLINE);
+			continue;
+		}
+
+		pt_task *t = readyT;
+		readyT = t->next;
+		set_deadline(t->deadline);
+
+		irqrestore(flags);
+		char state = t->func(t);
+		flags = irqsave();
+
+		switch (state)
+		{
+		case PT_YIELDED:
+			insert_ready(t);
+			break;
+		case PT_WAITING:
+			t->wakeup = RPI_GetTimeMicroSeconds() + PT_POLL_US;
+			insert_sleeping(t);
+			break;
+		case PT_SLEEPING:
+			insert_sleeping(t);
+			break;
+		default:
+			if (t->period != 0)
+			{
+				// From the period start, sleeps within the job do not shift it
+				t->release += t->period;
+				t->deadline += t->period;
+				t->wakeup = t->release;
+				insert_sleeping(t);
+			}
+			break;
+		}
+	}
+}
+
+/** @brief Starts a stackless task.
+ * @param t holds the task state and must stay valid while the task runs
+ * @param release is the absolute time of the first release in microseconds
+ * @param period is the period and relative deadline in microseconds, 0 for
+ * a one-shot task, which then has no deadline
+ */
+void pt_spawn(pt_task *t, pt_func func, int arg, uint64_t release, uint64_t period)
+{
+	irqflags_t flags = irqsave();
+
+	if (period != 0 && period < carrier_period)
+	{
+		carrier_period = period;
+		if (carrier_thread != NULL)
+			set_thread_period(carrier_thread, period);
+	}
+	if (!started)
+	{
+		// The period only sets the priority under SCHED_RM, the carrier never returns
+		spawnWithDeadline(carrier, 0, NO_DEADLINE, carrier_period);
+		started = 1;
+	}
+
+	t->lc = 0;
+	t->func = func;
+	t->arg = arg;
+	t->release = release;
+	t->wakeup = release;
+	t->period = period;
+	t->deadline = period != 0 ? release + period : NO_DEADLINE;
+	insert_sleeping(t);
+	if (carrierQ != NULL)
+		set_thread_deadline(carrierQ, next_deadline());
+	wake_one(&carrierQ);
+
+	irqrestore(flags);
+}
@@ -0,0 +1,84 @@
+/*
+ * Stackless protothread tasks for TinyThreads.
+ *
+ * A task is a function that is re-entered from the top every time it is
+ * scheduled and resumes at the statement where it last blocked, using the
+ * local continuation technique of Adam Dunkels' protothreads. Its state is
+ * the small pt_task structure, there is no stack per task, so local
+ * variables do not survive a blocking statement and must be kept in a
+ * structure that embeds pt_task.
+ *
+ * All tasks run in one carrier thread, ordered by earliest deadline. The
+ * carrier thread takes the deadline of the task it is running, so the
+ * tasks compete with ordinary threads in readyQ. Under SCHED_RM the
+ * carrier has the shortest period of its tasks.
+ *
+ * Example, an LED pattern with a period of 100 ms:
+ *
+ *   static char blink(pt_task *t)
+ *   {
+ *       PT_BEGIN(t);
+ *       led_on();
+ *       PT_SLEEP(t, 20000);
+ *       led_off();
+ *       PT_END(t);
+ *   }
+ *   ...
+ *   static pt_task blinker;
+ *   pt_spawn(&blinker, blink, 0, RPI_GetTimeMicroSeconds(), 100000);
+ */
+
+#ifndef _PT_H
+#define _PT_H
+
+#include <stdint.h>
+
+#include "rpi-systimer.h"
+
+/* Values returned by a task function */
+#define PT_WAITING  0   // Condition not met, polled again after PT_POLL_US
+#define PT_YIELDED  1   // Gives way to other tasks, still ready
+#define PT_SLEEPING 2   // Ready again at wakeup
+#define PT_ENDED    3   // Job done, periodic tasks are released again
+
+/* Interval at which tasks blocked in PT_WAIT_UNTIL() are polled */
+#define PT_POLL_US  1000
+
+typedef struct pt_task pt_task;
+typedef char (*pt_func)(pt_task *t);
+
+struct pt_task {
+    unsigned short lc;  // Local continuation, the line to resume at
+    pt_func func;
+    int arg;
+    uint64_t release;   // Absolute start of the current period
+    uint64_t wakeup;    // Absolute time at which the task becomes ready
+    uint64_t deadline;  // Absolute deadline, tasks run in deadline order
+    uint64_t period;    // Period and relative deadline, 0 for one-shot tasks
+    pt_task *next;
+};
+
+#define PT_BEGIN(t) \
+    { char PT_YIELD_FLAG = 1; (void)PT_YIELD_FLAG; switch ((t)->lc) { case 0:
+
+#define PT_END(t) \
+    } PT_YIELD_FLAG = 0; (t)->lc = 0; return PT_ENDED; }
+
+#define PT_WAIT_UNTIL(t, cond) \
+    do { (t)->lc = __LINE__; case __LINE__: \
+        if (!(cond)) return PT_WAITING; } while (0)
+
+#define PT_YIELD(t) \
+    do { PT_YIELD_FLAG = 0; (t)->lc = __LINE__; case __LINE__: \
+        if (PT_YIELD_FLAG == 0) return PT_YIELDED; } while (0)
+
+#define PT_SLEEP(t, us) \
+    do { (t)->wakeup = RPI_GetTimeMicroSeconds() + (us); \
+        (t)->lc = __LINE__; return PT_SLEEPING; case __LINE__:; } while (0)
+
+#define PT_EXIT(t) \
+    do { (t)->lc = 0; return PT_ENDED; } while (0)
+
+void pt_spawn(pt_task *t, pt_func func, int arg, uint64_t release, uint64_t period);
+
+#endif
@@ -34,6 +34,15 @@
 #define RPI_ARMTIMER_CTRL_ENABLE        ( 1 << 7 )
 #define RPI_ARMTIMER_CTRL_DISABLE       ( 0 << 7 )
 
+/** @brief 1 : Free running counter enabled, counting at
+    apb_clock/(prescale+1) with the prescale in bits 16-23 */
+#define RPI_ARMTIMER_CTRL_FRC_ENABLE    ( 1 << 9 )
+#define RPI_ARMTIMER_CTRL_FRC_PRESCALE(x)   ( ( (x) & 0xFF ) << 16 )
+
+/** @brief Largest Load of the 23-bit counter and largest PreDivider */
+#define RPI_ARMTIMER_MAX_LOAD           0x7FFFFF
+#define RPI_ARMTIMER_MAX_PREDIVIDER     0x3FF
+
 
 /** @brief Section 14.2 of the BCM2835 Peripherals documentation details
     the register layout for the ARM side timer */
@@ -0,0 +1,62 @@
+/*
+    The ARM generic timer of the Cortex-A53, one per core, accessed through
+    CP15. Each core has its own physical (CNTP) and virtual (CNTV) timer,
+    both comparing against the 64-bit system counter, which runs from the
+    19.2 MHz crystal on the Raspberry Pi 3. The interrupts are routed with
+    RPI_LOCAL_TIMER_INT_CONTROL() of the core, see rpi-local.h.
+
+    The functions access the timer of the calling core.
+*/
+
+#ifndef RPI_GENTIMER_H
+#define RPI_GENTIMER_H
+
+#include <stdint.h>
+
+/** @brief Counter frequency assumed when the firmware left CNTFRQ unset */
+#define RPI_GENTIMER_DEFAULT_HZ     19200000UL
+
+/** @brief Bits of CNTP_CTL and CNTV_CTL */
+#define RPI_GENTIMER_CTL_ENABLE     ( 1 << 0 )
+#define RPI_GENTIMER_CTL_IMASK      ( 1 << 1 )
+#define RPI_GENTIMER_CTL_ISTATUS    ( 1 << 2 )
+
+/** @return the counter frequency in Hz */
+static inline uint32_t RPI_GenTimerFrequency( void )
+{
+    uint32_t hz;
+
+    __asm volatile( "mrc p15, 0, %0, c14, c0, 0" : "=r"( hz ) );
+    return hz ? hz : RPI_GENTIMER_DEFAULT_HZ;
+}
+
+/** @return the physical count, CNTPCT */
+static inline uint64_t RPI_GenTimerCount( void )
+{
+    uint32_t lo, hi;
+
+    __asm volatile( "isb\n mrrc p15, 0, %0, %1, c14" : "=r"( lo ), "=r"( hi ) : : "memory" );
+    return ( (uint64_t)hi << 32 ) | lo;
+}
+
+/** @brief Sets CNTP_CVAL, the count at which the physical timer fires */
+static inline void RPI_GenTimerSetCompare( uint64_t cval )
+{
+    __asm volatile( "mcrr p15, 2, %0, %1, c14" : : "r"( (uint32_t)cval ), "r"( (uint32_t)( cval >> 32 ) ) );
+}
+
+static inline uint64_t RPI_GenTimerGetCompare( void )
+{
+    uint32_t lo, hi;
+
+    __asm volatile( "mrrc p15, 2, %0, %1, c14" : "=r"( lo ), "=r"( hi ) );
+    return ( (uint64_t)hi << 32 ) | lo;
+}
+
+/** @brief Sets CNTP_CTL of the physical timer */
+static inline void RPI_GenTimerSetControl( uint32_t ctl )
+{
+    __asm volatile( "mcr p15, 0, %0, c14, c2, 1\n isb" : : "r"( ctl ) : "memory" );
+}
+
+#endif
@@ -14,9 +14,186 @@
 #include <stdint.h>
 #include "rpi-armtimer.h"
 #include "rpi-interrupts.h"
+#include "rpi-local.h"
+#include "rpi-systimer.h"
 #include "tinythreads.h"
+#include "latency.h"
+#include "irqstat.h"
+#include "fastcode.h"
+
+volatile unsigned int ticks = 0;
+
+/** @brief The BCM2835 Interupt controller peripheral at it's base address */
+static rpi_irq_controller_t* rpiIRQController =
+        (rpi_irq_controller_t*)RPI_INTERRUPT_CONTROLLER_BASE;
+
+/** @brief Handlers registered with irq_register(), indexed by source */
+static struct {
+    irq_handler_t handler;
+    void* arg;
+} irqHandlers[IRQ_NSOURCES];
+
+/** @brief Handler of the source routed to FIQ by fiq_route() */
+static void (* fiqHandler)(void) = 0;
+
+/** @brief System timer when IRQs were last masked */
+static uint32_t masked_since;
+/** @brief Longest window with IRQs masked since the last reset */
+static uint32_t masked_max = 0;
+
+/**
+    @brief Called whenever IRQs go from unmasked to masked
+*/
+void __fastcode irq_masked_begin(void)
+{
+    masked_since = RPI_GetSystemTimer()->counter_lo;
+}
+
+/**
+    @brief Called right before IRQs are unmasked again
+*/
+void irq_masked_end(void)
+{
+    uint32_t masked = RPI_GetSystemTimer()->counter_lo - masked_since;
+
+    if( masked > masked_max )
+        masked_max = masked;
+}
+
+/**
+    @brief Returns the longest window in microseconds during which IRQs were
+    masked, including the time spent in the IRQ handler itself
+*/
+uint32_t irq_masked_max_us(void)
+{
+    return masked_max;
+}
+
+void irq_masked_reset(void)
+{
+    irqflags_t flags = irqsave();
+    masked_max = 0;
+    irqrestore(flags);
+}
+
+/**
+    @brief Return the IRQ Controller register set
+*/
+rpi_irq_controller_t* RPI_GetIrqController( void )
+{
+    return rpiIRQController;
+}
+
+/**
+    @brief Enables an interrupt source in the controller
+
+    Core-local sources are enabled for the calling core only.
+*/
+void irq_enable(int source)
+{
+    if( source >= IRQ_NSOURCES )
+        return;
+    else if( source >= IRQ_LOCAL_MAILBOX(0) )
+        RPI_LOCAL_MAILBOX_INT_CONTROL( RPI_GetCoreId() ) |= 1 << ( source - IRQ_LOCAL_MAILBOX(0) );
+    else if( source >= IRQ_LOCAL_BASE )
+        RPI_LOCAL_TIMER_INT_CONTROL( RPI_GetCoreId() ) |= 1 << ( source - IRQ_LOCAL_BASE );
+    else if( source >= IRQ_ARM_BASE )
+        rpiIRQController->Enable_Basic_IRQs = 1 << ( source - IRQ_ARM_BASE );
+    else if( source >= 32 )
+        rpiIRQController->Enable_IRQs_2 = 1 << ( source - 32 );
+    else
+        rpiIRQController->Enable_IRQs_1 = 1 << source;
+}
+
+/**
+    @brief Disables an interrupt source in the controller
+
+    Core-local sources are disabled for the calling core only.
+*/
+void irq_disable(int source)
+{
+    if( source >= IRQ_NSOURCES )
+        return;
+    else if( source >= IRQ_LOCAL_MAILBOX(0) )
+        RPI_LOCAL_MAILBOX_INT_CONTROL( RPI_GetCoreId() ) &= ~( 1 << ( source - IRQ_LOCAL_MAILBOX(0) ) );
+    else if( source >= IRQ_LOCAL_BASE )
+        RPI_LOCAL_TIMER_INT_CONTROL( RPI_GetCoreId() ) &= ~( 1 << ( source - IRQ_LOCAL_BASE ) );
+    else if( source >= IRQ_ARM_BASE )
+        rpiIRQController->Disable_Basic_IRQs = 1 << ( source - IRQ_ARM_BASE );
+    else if( source >= 32 )
+        rpiIRQController->Disable_IRQs_2 = 1 << ( source - 32 );
+    else
+        rpiIRQController->Disable_IRQs_1 = 1 << source;
+}
+
+/**
+    @brief Installs the handler of an interrupt source and enables the source
+
+    The handler runs in interrupt context with IRQs masked and must clear
+    the interrupt in its peripheral. Passing a NULL handler disables the
+    source.
+
+    @return 0, or -1 if the source does not exist
+*/
+int irq_register(int source, irq_handler_t handler, void* arg)
+{
+    irqflags_t flags;
+
+    if( source < 0 || source >= IRQ_NSOURCES )
+        return -1;
+
+    flags = irqsave();
+    irqHandlers[source].handler = handler;
+    irqHandlers[source].arg = arg;
+    if( handler )
+        irq_enable( source );
+    else
+        irq_disable( source );
+    irqrestore( flags );
+
+    return 0;
+}
+
+/**
+    @brief Routes a source of the BCM2835 controller to FIQ instead of IRQ
+
+    Only one source can be routed to FIQ. The handler runs in FIQ mode on
+    the banked registers and may preempt critical sections of the kernel,
+    which only mask IRQs, so it must not touch kernel data; it can pass work
+    on to an IRQ handler, e.g., by raising a core-local mailbox interrupt.
+    FIQs are unmasked for the caller. Threads that were preempted before
+    keep FIQs masked, so this is best called from main before the first
+    thread runs.
+
+    @return 0, or -1 if the source cannot be routed to FIQ
+*/
+int fiq_route(int source, void (*handler)(void))
+{
+    if( source < 0 || source >= IRQ_LOCAL_BASE || handler == 0 )
+        return -1;
+
+    irq_disable( source );
+    fiqHandler = handler;
+    rpiIRQController->FIQ_control = RPI_FIQ_ENABLE | source;
+    __asm volatile("cpsie f \n" : : : "memory");
+
+    return 0;
+}
 
-volatile int ticks = -1;
+/**
+    @brief Stops routing the FIQ source, which stays disabled
+*/
+void fiq_unroute(void)
+{
+    __asm volatile("cpsid f \n" : : : "memory");
+    rpiIRQController->FIQ_control = 0;
+    fiqHandler = 0;
+}
+
+void RPI_EnableARMTimerInterrupt(void)
+{
+    irq_enable( IRQ_ARM_TIMER );
+}
 /**
     @brief The Reset vector interrupt handler
 
@@ -83,6 +260,37 @@ void __attribute__((interrupt("ABORT"))) data_abort_vector(void)
 }
 
 
+/**
+    @brief The IRQ entry and exit path
+
+    The vector table branches here instead of to interrupt_vector(). The
+    handler switches from IRQ to SVC mode, so everything runs on the stack of
+    the interrupted thread: the return address and SPSR are pushed with SRS,
+    followed by the caller-saved registers. After the C handler, irq_exit()
+    may switch to another thread, which is the same as the interrupted
+    thread being preempted in a function call. The thread is later resumed
+    here and returns from the exception with RFE.
+*/
+__asm__ (
+	".section .fast.text.irq_entry, \"ax\", %progbits\n"
+	".global irq_entry\n"
+	".type irq_entry, %function\n"
+	"irq_entry:\n"
+	"    sub     lr, lr, #4\n"				// Return to the interrupted instruction
+	"    srsdb   sp!, #0x13\n"				// Push LR_irq and SPSR_irq on the SVC stack
+	"    cps     #0x13\n"					// SVC mode, IRQs remain masked
+	"    push    {r0-r3, r12}\n"
+	"    and     r1, sp, #4\n"				// 8-byte align the stack for the C code
+	"    sub     sp, sp, r1\n"
+	"    push    {r1, lr}\n"
+	"    bl      interrupt_vector\n"
+	"    bl      irq_exit\n"
+	"    pop     {r1, lr}\n"
+	"    add     sp, sp, r1\n"
+	"    pop     {r0-r3, r12}\n"
+	"    rfeia   sp!\n"
+);
+
 /**
     @brief The IRQ Interrupt handler
 
@@ -90,16 +298,52 @@ void __attribute__((interrupt("ABORT"))) data_abort_vector(void)
     up to the handler to determine the source of the interrupt and most
     importantly clear the interrupt flag so that the interrupt won't
     immediately put us back into the start of the handler again.
+
+    Called from irq_entry. The handler does not switch threads itself, it
+    only marks a reschedule as pending.
+
+    Each pending register is scanned with CLZ, highest source first, and
+    the registered handlers are called. A source without a handler is
+    disabled, so it cannot keep the CPU in the handler. The entry latency
+    and duration of every handler are recorded, see irqstat.h.
 */
-void __attribute__((interrupt("IRQ"))) interrupt_vector(void)
+static void __fastcode dispatch_pending(uint32_t pending, int base)
 {
-	if( RPI_GetArmTimer()->MaskedIRQ ) {
-        /* Clear the ARM Timer interrupt - it's the only interrupt we have
-           enabled, so we want don't have to work out which interrupt source
-           caused us to interrupt */
-        RPI_GetArmTimer()->IRQClear = 1;
-        ticks++;
-        scheduler();
+    while( pending )
+    {
+        int bit = 31 - __builtin_clz( pending );
+        int source = base + bit;
+
+        pending &= ~( 1UL << bit );
+        if( irqHandlers[source].handler )
+        {
+            uint32_t entry = irqstat_enter( source );
+
+            irqHandlers[source].handler( irqHandlers[source].arg );
+            irqstat_exit( source, entry );
+        }
+        else
+            irq_disable( source );
+    }
+}
+
+void __fastcode interrupt_vector(void)
+{
+    uint32_t basic;
+
+    irq_masked_begin();
+    LATENCY_IRQ_STAMP();
+    irq_enter();
+
+    dispatch_pending( RPI_LOCAL_IRQ_SOURCE( RPI_GetCoreId() ) & RPI_LOCAL_SRC_MASK,
+                      IRQ_LOCAL_BASE );
+
+    basic = rpiIRQController->IRQ_basic_pending;
+    dispatch_pending( basic & 0xFF, IRQ_ARM_BASE );
+    if( basic & RPI_BASIC_PENDING_GPU_MASK )
+    {
+        dispatch_pending( rpiIRQController->IRQ_pending_1, 0 );
+        dispatch_pending( rpiIRQController->IRQ_pending_2, 32 );
     }
 }
 
@@ -117,6 +361,8 @@ void __attribute__((interrupt("IRQ"))) interrupt_vector(void)
     only be one source, but the prologue and epilogue code is quite different.
     It's much faster on the FIQ interrupt handler.
 
+    The source and its handler are set with fiq_route().
+
     The prologue is the code that the compiler inserts at the start of the
     function, if you like, think of the opening curly brace of the function as
     being the prologue code. For the FIQ interrupt handler this is nearly
@@ -129,7 +375,7 @@ void __attribute__((interrupt("IRQ"))) interrupt_vector(void)
     empty because the CPU has switched to a fresh set of registers and so has
     not altered the main set of registers.
 */
-void __attribute__((interrupt("FIQ"))) fast_interrupt_vector(void)
+void __attribute__((interrupt("FIQ"))) __fastcode fast_interrupt_vector(void)
 {
-
+    fiqHandler();
 }
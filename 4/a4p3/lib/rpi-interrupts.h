@@ -17,7 +17,122 @@
 
 #include "rpi-base.h"
 
-extern volatile int ticks;
+/** @brief See Section 7.5 of the BCM2836 ARM Peripherals documentation, the base
+    address of the controller is actually xxxxB000, but there is a 0x200 offset
+    to the first addressable register for the interrupt controller, so offset the
+    base to the first register */
+#define RPI_INTERRUPT_CONTROLLER_BASE   ( PERIPHERAL_BASE + 0xB200UL )
+
+/** @brief Bits in the Enable_Basic_IRQs register to enable various interrupts.
+    See the BCM2835 ARM Peripherals manual, section 7.5 */
+#define RPI_BASIC_ARM_TIMER_IRQ         (1 << 0)
+#define RPI_BASIC_ARM_MAILBOX_IRQ       (1 << 1)
+#define RPI_BASIC_ARM_DOORBELL_0_IRQ    (1 << 2)
+#define RPI_BASIC_ARM_DOORBELL_1_IRQ    (1 << 3)
+#define RPI_BASIC_GPU_0_HALTED_IRQ      (1 << 4)
+#define RPI_BASIC_GPU_1_HALTED_IRQ      (1 << 5)
+#define RPI_BASIC_ACCESS_ERROR_1_IRQ    (1 << 6)
+#define RPI_BASIC_ACCESS_ERROR_0_IRQ    (1 << 7)
+
+/** @brief Bits of IRQ_basic_pending that tell that IRQ_pending_1 or
+    IRQ_pending_2 may have bits set, including the GPU interrupts that are
+    only summarized in bits 10-20 */
+#define RPI_BASIC_PENDING_GPU_MASK      0x001FFF00
+
+/** @brief The interrupt controller memory mapped register set */
+typedef struct {
+    volatile uint32_t IRQ_basic_pending;
+    volatile uint32_t IRQ_pending_1;
+    volatile uint32_t IRQ_pending_2;
+    volatile uint32_t FIQ_control;
+    volatile uint32_t Enable_IRQs_1;
+    volatile uint32_t Enable_IRQs_2;
+    volatile uint32_t Enable_Basic_IRQs;
+    volatile uint32_t Disable_IRQs_1;
+    volatile uint32_t Disable_IRQs_2;
+    volatile uint32_t Disable_Basic_IRQs;
+    } rpi_irq_controller_t;
+
+/** @brief FIQ_control: routes one source to FIQ, numbered as below */
+#define RPI_FIQ_ENABLE                  (1 << 7)
+
+/** @brief Interrupt sources of irq_register(). GPU interrupts 0-63 are
+    the bits of IRQ_pending_1 and IRQ_pending_2, followed by the ARM
+    peripherals in bits 0-7 of IRQ_basic_pending, numbered as in
+    FIQ_control, and by the generic timer and mailbox sources of the
+    calling core. Its GPU, PMU, AXI and local timer sources are not
+    supported */
+#define IRQ_SYSTIMER_1      1
+#define IRQ_SYSTIMER_3      3
+#define IRQ_AUX             29      // Mini UART, SPI1 and SPI2
+#define IRQ_GPIO_0          49
+#define IRQ_GPIO_1          50
+#define IRQ_GPIO_2          51
+#define IRQ_GPIO_3          52
+#define IRQ_I2C             53
+#define IRQ_SPI             54
+#define IRQ_PCM             55
+#define IRQ_UART            57
+#define IRQ_ARM_BASE        64
+#define IRQ_ARM_TIMER       ( IRQ_ARM_BASE + 0 )
+#define IRQ_ARM_MAILBOX     ( IRQ_ARM_BASE + 1 )
+#define IRQ_ARM_DOORBELL_0  ( IRQ_ARM_BASE + 2 )
+#define IRQ_ARM_DOORBELL_1  ( IRQ_ARM_BASE + 3 )
+#define IRQ_LOCAL_BASE      ( IRQ_ARM_BASE + 8 )
+#define IRQ_LOCAL_CNTPNS    ( IRQ_LOCAL_BASE + 1 )  // ARM generic timer
+#define IRQ_LOCAL_MAILBOX(n)    ( IRQ_LOCAL_BASE + 4 + (n) )
+#define IRQ_NSOURCES        ( IRQ_LOCAL_BASE + 8 )
+
+typedef void (*irq_handler_t)(void* arg);
+
+/** @brief I bit of the CPSR, set while IRQs are masked */
+#define CPSR_IRQ_INHIBIT    0x80
+
+/** @brief Flags for irqrestore() that unmask IRQs */
+#define IRQ_UNMASKED        0
+
+typedef uint32_t irqflags_t;
+
+extern volatile unsigned int ticks;
+extern rpi_irq_controller_t* RPI_GetIrqController(void);
 extern void RPI_EnableARMTimerInterrupt(void);
 
+extern int irq_register(int source, irq_handler_t handler, void* arg);
+extern void irq_enable(int source);
+extern void irq_disable(int source);
+
+extern int fiq_route(int source, void (*handler)(void));
+extern void fiq_unroute(void);
+
+extern void irq_masked_begin(void);
+extern void irq_masked_end(void);
+extern uint32_t irq_masked_max_us(void);
+extern void irq_masked_reset(void);
+
+/** @brief Masks IRQs and returns the previous interrupt state.
+    Critical sections can be nested, each irqsave() must be paired with an
+    irqrestore() of the returned flags. */
+__attribute__((always_inline)) static inline irqflags_t irqsave(void)
+{
+    irqflags_t flags;
+
+    __asm volatile("mrs %0, cpsr \n"
+                   "cpsid i \n" : "=r"(flags) : : "memory");
+    if( !( flags & CPSR_IRQ_INHIBIT ) )
+        irq_masked_begin();
+
+    return flags;
+}
+
+/** @brief Restores the interrupt state saved by irqsave(). IRQs are only
+    unmasked when they were unmasked before the matching irqsave(). */
+__attribute__((always_inline)) static inline void irqrestore(irqflags_t flags)
+{
+    if( !( flags & CPSR_IRQ_INHIBIT ) )
+    {
+        irq_masked_end();
+        __asm volatile("cpsie i \n" : : : "memory");
+    }
+}
+
 #endif
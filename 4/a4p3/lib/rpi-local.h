@@ -0,0 +1,50 @@
+/*
+    Core-local peripherals of the BCM2836/BCM2837 (Raspberry Pi 2 and 3),
+    see the "Quad-A7 control" document (QA7_rev3.4)
+*/
+
+#ifndef RPI_LOCAL_H
+#define RPI_LOCAL_H
+
+#include <stdint.h>
+
+#define RPI_LOCAL_BASE                      0x40000000UL
+#define RPI_NCORES                          4
+
+#define RPI_LOCAL_REG(offset)               ( *(volatile uint32_t*)( RPI_LOCAL_BASE + (offset) ) )
+
+/** @brief Routing of the ARM generic timer interrupts of a core, IRQ bits
+    0-3 and FIQ bits 4-7 */
+#define RPI_LOCAL_TIMER_INT_CONTROL(core)   RPI_LOCAL_REG( 0x40 + 4 * (core) )
+/** @brief Routing of the four mailboxes of a core, IRQ bits 0-3 and FIQ
+    bits 4-7 */
+#define RPI_LOCAL_MAILBOX_INT_CONTROL(core) RPI_LOCAL_REG( 0x50 + 4 * (core) )
+/** @brief Pending interrupts of a core */
+#define RPI_LOCAL_IRQ_SOURCE(core)          RPI_LOCAL_REG( 0x60 + 4 * (core) )
+/** @brief Write 1 to set bits of a mailbox of a core */
+#define RPI_LOCAL_MAILBOX_SET(core, n)      RPI_LOCAL_REG( 0x80 + 16 * (core) + 4 * (n) )
+/** @brief Write 1 to clear bits of a mailbox of a core */
+#define RPI_LOCAL_MAILBOX_CLEAR(core, n)    RPI_LOCAL_REG( 0xC0 + 16 * (core) + 4 * (n) )
+
+/** @brief Bits of RPI_LOCAL_IRQ_SOURCE */
+#define RPI_LOCAL_SRC_CNTPS                 ( 1 << 0 )
+#define RPI_LOCAL_SRC_CNTPNS                ( 1 << 1 )
+#define RPI_LOCAL_SRC_CNTHP                 ( 1 << 2 )
+#define RPI_LOCAL_SRC_CNTV                  ( 1 << 3 )
+#define RPI_LOCAL_SRC_MAILBOX(n)            ( 1 << ( 4 + (n) ) )
+#define RPI_LOCAL_SRC_GPU                   ( 1 << 8 )
+/** @brief Sources dispatched as core-local IRQs, the generic timers and the
+    mailboxes. The GPU is dispatched from the BCM2835 controller, and the
+    PMU, AXI and local timer sources are not supported */
+#define RPI_LOCAL_SRC_MASK                  0xFF
+
+/** @return the number of the calling core, 0-3 */
+static inline int RPI_GetCoreId( void )
+{
+    uint32_t mpidr;
+
+    __asm volatile( "mrc p15, 0, %0, c0, c0, 5" : "=r"( mpidr ) );
+    return mpidr & 0x3;
+}
+
+#endif
@@ -0,0 +1,159 @@
+/*
+    VideoCore mailbox property interface
+*/
+
+#include <stdint.h>
+
+#include "rpi-mailbox.h"
+#include "tinythreads.h"
+
+static rpi_mailbox_t* rpiMailbox = (rpi_mailbox_t*)RPI_MAILBOX_BASE;
+
+/** @brief Serializes the request/response pairs of different threads */
+static mutex mailboxLock = MUTEX_INIT;
+
+rpi_mailbox_t* RPI_GetMailbox(void)
+{
+    return rpiMailbox;
+}
+
+/**
+    @brief Passes a property buffer to the VideoCore and waits for the reply
+
+    The buffer must be 16-byte aligned, its first word holds its size in
+    bytes and the second the request code, followed by the tags and an end
+    tag. The reply is written into the same buffer. The MMU is off, so data
+    accesses are not cached and the buffer needs no cache maintenance.
+
+    @return 0 if the VideoCore processed all tags, -1 otherwise
+*/
+int RPI_PropertyCall(uint32_t* buffer)
+{
+    uint32_t message = ( (uint32_t)buffer & ~0xFUL ) | RPI_MAILBOX_CH_PROPERTY;
+    uint32_t reply;
+
+    lock( &mailboxLock );
+
+    __asm volatile("dsb \n" : : : "memory");
+    while( rpiMailbox->Status & RPI_MAILBOX_FULL )
+        ;
+    rpiMailbox->Write = message;
+
+    do
+    {
+        while( rpiMailbox->Status & RPI_MAILBOX_EMPTY )
+            ;
+        reply = rpiMailbox->Read;
+    } while( reply != message );
+    __asm volatile("dsb \n" : : : "memory");
+
+    unlock( &mailboxLock );
+
+    return buffer[1] == RPI_PROPERTY_SUCCESS ? 0 : -1;
+}
+
+/**
+    @brief Runs a single tag that takes an id and returns an id and a value
+
+    @return the value, or 0 if the call failed
+*/
+static uint32_t RPI_PropertyGet(uint32_t tag, uint32_t id)
+{
+    uint32_t buffer[8] __attribute__((aligned(16))) = {
+        sizeof(buffer), RPI_PROPERTY_REQUEST,
+        tag, 8, 0, id, 0,
+        RPI_TAG_END
+    };
+
+    if( RPI_PropertyCall( buffer ) != 0 )
+        return 0;
+
+    return buffer[6];
+}
+
+/**
+    @brief Returns the rate of a clock in Hz, or 0 if the VideoCore does not
+    know the clock
+*/
+uint32_t RPI_GetClockRate(uint32_t clock_id)
+{
+    return RPI_PropertyGet( RPI_TAG_GET_CLOCK_RATE, clock_id );
+}
+
+/**
+    @brief Returns the highest rate of a clock in Hz that the firmware
+    allows, i.e., arm_freq of config.txt for the ARM clock, or 0
+*/
+uint32_t RPI_GetMaxClockRate(uint32_t clock_id)
+{
+    return RPI_PropertyGet( RPI_TAG_GET_MAX_CLOCK_RATE, clock_id );
+}
+
+/**
+    @brief Returns the lowest rate of a clock in Hz, or 0
+*/
+uint32_t RPI_GetMinClockRate(uint32_t clock_id)
+{
+    return RPI_PropertyGet( RPI_TAG_GET_MIN_CLOCK_RATE, clock_id );
+}
+
+/**
+    @brief Sets the rate of a clock
+
+    The firmware clamps the rate to its limits. Turbo mode is not touched,
+    since it would also change the core clock behind the UART and the ARM
+    timer.
+
+    @return the rate that was set in Hz, or 0 if the call failed
+*/
+uint32_t RPI_SetClockRate(uint32_t clock_id, uint32_t hz)
+{
+    uint32_t buffer[12] __attribute__((aligned(16))) = {
+        sizeof(buffer), RPI_PROPERTY_REQUEST,
+        RPI_TAG_SET_CLOCK_RATE, 12, 0, clock_id, hz, 1,
+        RPI_TAG_END
+    };
+
+    if( RPI_PropertyCall( buffer ) != 0 )
+        return 0;
+
+    return buffer[6];
+}
+
+/**
+    @brief Returns the SoC temperature in thousandths of a degree Celsius,
+    or 0 if the call failed
+*/
+uint32_t RPI_GetTemperature(void)
+{
+    return RPI_PropertyGet( RPI_TAG_GET_TEMPERATURE, 0 );
+}
+
+/**
+    @brief Returns the temperature at which the firmware starts to throttle
+    the clocks, in thousandths of a degree Celsius, or 0
+*/
+uint32_t RPI_GetMaxTemperature(void)
+{
+    return RPI_PropertyGet( RPI_TAG_GET_MAX_TEMPERATURE, 0 );
+}
+
+/**
+    @brief Reads the throttled status, see RPI_THROTTLED_*
+
+    @return 0, or -1 if the firmware does not report it
+*/
+int RPI_GetThrottled(uint32_t* status)
+{
+    uint32_t buffer[8] __attribute__((aligned(16))) = {
+        sizeof(buffer), RPI_PROPERTY_REQUEST,
+        RPI_TAG_GET_THROTTLED, 4, 0, 0xFFFF,
+        RPI_TAG_END
+    };
+
+    if( RPI_PropertyCall( buffer ) != 0 )
+        return -1;
+
+    *status = buffer[5];
+    return 0;
+}
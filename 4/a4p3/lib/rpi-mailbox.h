@@ -0,0 +1,72 @@
+/*
+    VideoCore mailbox property interface, see
+    https://github.com/raspberrypi/firmware/wiki/Mailbox-property-interface
+*/
+
+#ifndef RPI_MAILBOX_H
+#define RPI_MAILBOX_H
+
+#include <stdint.h>
+
+#include "rpi-base.h"
+
+#define RPI_MAILBOX_BASE            ( PERIPHERAL_BASE + 0xB880UL )
+
+/** @brief Bits of the status register */
+#define RPI_MAILBOX_FULL            0x80000000
+#define RPI_MAILBOX_EMPTY           0x40000000
+
+/** @brief Channel of the property tags, ARM to VideoCore */
+#define RPI_MAILBOX_CH_PROPERTY     8
+
+/** @brief Request and response codes of a property buffer */
+#define RPI_PROPERTY_REQUEST        0x00000000
+#define RPI_PROPERTY_SUCCESS        0x80000000
+
+/** @brief Property tags */
+#define RPI_TAG_GET_CLOCK_RATE      0x00030002
+#define RPI_TAG_GET_MAX_CLOCK_RATE  0x00030004
+#define RPI_TAG_GET_TEMPERATURE     0x00030006
+#define RPI_TAG_GET_MIN_CLOCK_RATE  0x00030007
+#define RPI_TAG_GET_MAX_TEMPERATURE 0x0003000A
+#define RPI_TAG_GET_THROTTLED       0x00030046
+#define RPI_TAG_SET_CLOCK_RATE      0x00038002
+#define RPI_TAG_END                 0x00000000
+
+/** @brief Clock ids of the clock tags */
+#define RPI_CLOCK_EMMC              1
+#define RPI_CLOCK_UART              2
+#define RPI_CLOCK_ARM               3
+#define RPI_CLOCK_CORE              4
+
+/** @brief Bits of the throttled status, the low bits are set while the
+    condition holds, the high bits once it occurred since boot */
+#define RPI_THROTTLED_UNDERVOLTAGE      ( 1 << 0 )
+#define RPI_THROTTLED_FREQ_CAPPED       ( 1 << 1 )
+#define RPI_THROTTLED_THROTTLED         ( 1 << 2 )
+#define RPI_THROTTLED_SOFT_TEMP_LIMIT   ( 1 << 3 )
+#define RPI_THROTTLED_OCCURRED(bit)     ( (bit) << 16 )
+
+/** @brief Mailbox 0, read by the ARM, and mailbox 1, written by the ARM */
+typedef struct {
+    volatile uint32_t Read;
+    volatile uint32_t Reserved[3];
+    volatile uint32_t Poll;
+    volatile uint32_t Sender;
+    volatile uint32_t Status;
+    volatile uint32_t Config;
+    volatile uint32_t Write;
+    } rpi_mailbox_t;
+
+
+extern rpi_mailbox_t* RPI_GetMailbox(void);
+extern int RPI_PropertyCall(uint32_t* buffer);
+extern uint32_t RPI_GetClockRate(uint32_t clock_id);
+extern uint32_t RPI_GetMaxClockRate(uint32_t clock_id);
+extern uint32_t RPI_GetMinClockRate(uint32_t clock_id);
+extern uint32_t RPI_SetClockRate(uint32_t clock_id, uint32_t hz);
+extern uint32_t RPI_GetTemperature(void);
+extern uint32_t RPI_GetMaxTemperature(void);
+extern int RPI_GetThrottled(uint32_t* status);
+
+#endif
@@ -18,11 +18,38 @@ rpi_sys_timer_t* RPI_GetSystemTimer(void)
     return rpiSystemTimer;
 }
 
+/**
+    @brief Returns the 64-bit free running system timer, in microseconds
+
+    The counter is read as two 32-bit words. If counter_hi changed while
+    counter_lo was read, counter_lo has wrapped in between and both words
+    are read again. The counter cannot wrap twice within a few cycles.
+*/
+uint64_t RPI_GetTimeMicroSeconds(void)
+{
+    uint32_t hi = rpiSystemTimer->counter_hi;
+    uint32_t lo = rpiSystemTimer->counter_lo;
+
+    if( rpiSystemTimer->counter_hi != hi )
+    {
+        hi = rpiSystemTimer->counter_hi;
+        lo = rpiSystemTimer->counter_lo;
+    }
+
+    return ( (uint64_t)hi << 32 ) | lo;
+}
+
+/**
+    @brief Busy-waits for a number of microseconds
+
+    Meant for short hardware delays. Threads that wait for longer than a
+    tick should call thread_sleep_us() instead, which lets other threads run.
+*/
 void RPI_WaitMicroSeconds( uint32_t us )
 {
-    volatile uint32_t ts = rpiSystemTimer->counter_lo;
+    uint64_t end = RPI_GetTimeMicroSeconds() + us;
 
-    while( ( rpiSystemTimer->counter_lo - ts ) < us )
+    while( RPI_GetTimeMicroSeconds() < end )
     {
         /* BLANK */
     }
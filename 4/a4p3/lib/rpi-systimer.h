@@ -17,6 +17,13 @@
 
 #define RPI_SYSTIMER_BASE       ( PERIPHERAL_BASE + 0x3000UL )
 
+/** @brief Match flags in control_status, write 1 to clear. Channels 0 and 2
+    are used by the GPU, channels 1 and 3 are free for the ARM */
+#define RPI_SYSTIMER_M0         ( 1 << 0 )
+#define RPI_SYSTIMER_M1         ( 1 << 1 )
+#define RPI_SYSTIMER_M2         ( 1 << 2 )
+#define RPI_SYSTIMER_M3         ( 1 << 3 )
+
 typedef struct {
     volatile uint32_t control_status;
     volatile uint32_t counter_lo;
@@ -29,6 +36,7 @@ typedef struct {
 
 
 extern rpi_sys_timer_t* RPI_GetSystemTimer(void);
+extern uint64_t RPI_GetTimeMicroSeconds(void);
 extern void RPI_WaitMicroSeconds( uint32_t us );
 
 #endif
@@ -80,7 +80,7 @@ __asm__ (
 	"_prefetch_abort_vector_h:           .word   prefetch_abort_vector\n"
 	"_data_abort_vector_h:               .word   data_abort_vector\n"
 	"_unused_handler_h:                  .word   _reset_\n"
-	"_interrupt_vector_h:                .word   interrupt_vector\n"
+	"_interrupt_vector_h:                .word   irq_entry\n"
 	"_fast_interrupt_vector_h:           .word   fast_interrupt_vector\n"
 
 	"_reset_:\n"
@@ -112,6 +112,13 @@ __asm__ (
 	"    cmp r12, #CPSR_MODE_HYPERVISOR\n"
 	"    bne _multicore_park\n"
 
+	     				// Give SVC mode access to the physical counter and timer of the generic timer (CNTHCTL.PL1PCTEN and
+	     				// PL1PCEN) and zero the virtual offset, both are only writable from hypervisor mode
+	"    mov r11, #3\n"
+	"    mcr p15, 4, r11, c14, c1, 0\n"
+	"    mov r11, #0\n"
+	"    mcrr p15, 4, r11, r11, c14\n"
+
 	     				// We're in hypervisor mode and we need to switch back in order to allow us to continue successfully
 	"    mrs r12, CPSR\n"
 	"    bic r12, r12, #CPSR_MODE_MASK\n"
@@ -138,6 +145,11 @@ __asm__ (
 	"    ldmia   r0!,{r2, r3, r4, r5, r6, r7, r8, r9}\n"
 	"    stmia   r1!,{r2, r3, r4, r5, r6, r7, r8, r9}\n"
 
+	     				// The FIQ handler runs on its own stack below the IRQ stack
+	"    mov r0, #(CPSR_MODE_FIQ | CPSR_IRQ_INHIBIT | CPSR_FIQ_INHIBIT )\n"
+	"    msr cpsr_c, r0\n"
+	"    ldr sp, =0x6000\n"
+
 	     				// We're going to use interrupt mode, so setup the interrupt mode
 	     				// stack pointer which differs to the application stack pointer:
 	"    mov r0, #(CPSR_MODE_IRQ | CPSR_IRQ_INHIBIT | CPSR_FIQ_INHIBIT )\n"
@@ -219,6 +231,8 @@ __asm__ (
 void SystemInit(void)
 {
 	extern char _sbss, _ebss;
+	extern char _data, _sdata, _edata;
+	extern char _fast, _sfast, _efast;
 
 	typedef void (*func)(void);
 	extern func __preinit_array_start[], __preinit_array_end;
@@ -227,6 +241,16 @@ void SystemInit(void)
 
 	extern int main();
 
+	/* copy .data and .fast unless they run where the image is loaded */
+	if (&_data != &_sdata)
+		memcpy(&_sdata, &_data, &_edata - &_sdata);
+	if (&_fast != &_sfast)
+	{
+		memcpy(&_sfast, &_fast, &_efast - &_sfast);
+		/* invalidate the instruction cache */
+		__asm__ volatile("MCR p15, 0, %0, c7, c5, 0\n DSB\n ISB" : : "r"(0) : "memory");
+	}
+
 	/* clear .bss */
 	memset(&_sbss, 0, &_ebss - &_sbss);
 
@@ -0,0 +1,310 @@
+/*
+ * Kernel tick from the ARM timer, calibrated against the system timer.
+ *
+ * The ARM timer counts the APB clock, which is the core clock of the
+ * VideoCore and changes when the firmware scales it. The rate reported by
+ * the mailbox is checked by counting APB cycles with the free running
+ * counter of the ARM timer over a known number of 1 MHz system timer
+ * ticks. If the two disagree, the measured rate is used.
+ *
+ * Alternatively, each core takes its tick from its own ARM generic timer,
+ * which counts the crystal and is independent of clock scaling, routed to
+ * the core itself through the local interrupt controller.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tick.h"
+#include "rpi-armtimer.h"
+#include "rpi-gentimer.h"
+#include "rpi-interrupts.h"
+#include "rpi-local.h"
+#include "rpi-mailbox.h"
+#include "rpi-systimer.h"
+#include "tinythreads.h"
+#include "latency.h"
+#include "irqstat.h"
+#include "fastcode.h"
+
+/* Rate assumed if the mailbox does not answer */
+#define DEFAULT_APB_HZ 250000000
+/* Length of the APB clock measurement */
+#define CALIBRATION_US 10000
+
+static uint32_t apb_hz = 0;
+static uint32_t tick_ns = 0;
+// @brief Set while the tick is routed to FIQ.
+static int tick_fiq_on = 0;
+// @brief Counts per period of the generic timer tick of each core, 0 if off.
+static uint32_t local_interval[RPI_NCORES];
+static uint32_t local_tick_ns[RPI_NCORES];
+// @brief Timer counts per millisecond, to tell when the tick expired.
+// Per microsecond, the ARM timer would be 8 instead of 8.33 at a 1 Hz tick.
+static uint32_t arm_counts_per_ms = 1;
+static uint32_t local_counts_per_ms = 1;
+
+/** @brief Handler of the ARM timer IRQ, the kernel tick.
+ */
+static void __fastcode tick_irq(void *arg)
+{
+	RPI_GetArmTimer()->IRQClear = 1;
+	ticks++;
+	pend_reschedule();
+}
+
+/** @return the system timer at which the ARM timer last reached zero, from
+ * the counts it has gone down from Load since, see irqstat.h
+ */
+static uint32_t __fastcode tick_expiry(void)
+{
+	rpi_arm_timer_t *at = RPI_GetArmTimer();
+	uint32_t elapsed = (uint32_t)((uint64_t)(at->Load - at->Value) * 1000 / arm_counts_per_ms);
+
+	return RPI_GetSystemTimer()->counter_lo - elapsed;
+}
+
+/** @brief Handler of the ARM timer FIQ. Runs on the banked registers and
+ * leaves the reschedule to tick_kick(), through the core 0 mailbox 0 IRQ.
+ */
+static void __fastcode tick_fiq(void)
+{
+	LATENCY_IRQ_STAMP();
+	RPI_GetArmTimer()->IRQClear = 1;
+	ticks++;
+	RPI_LOCAL_MAILBOX_SET(0, 0) = 1;
+}
+
+static void __fastcode tick_kick(void *arg)
+{
+	RPI_LOCAL_MAILBOX_CLEAR(0, 0) = 1;
+	pend_reschedule();
+}
+
+/** @brief Handler of the generic timer IRQ of a core. The compare value
+ * advances by whole periods, so the tick does not drift with the latency
+ * of the handler.
+ */
+static void __fastcode local_tick_irq(void *arg)
+{
+	uint32_t interval = local_interval[RPI_GetCoreId()];
+	uint64_t next = RPI_GenTimerGetCompare() + interval;
+
+	// Periods lost while IRQs were masked are skipped, not caught up on
+	if ((int64_t)(next - RPI_GenTimerCount()) <= 0)
+		next = RPI_GenTimerCount() + interval;
+	RPI_GenTimerSetCompare(next);
+	ticks++;
+	pend_reschedule();
+}
+
+/** @return the system timer at which the generic timer of the calling core
+ * reached its compare value, see irqstat.h
+ */
+static uint32_t __fastcode local_tick_expiry(void)
+{
+	uint32_t counts = (uint32_t)(RPI_GenTimerCount() - RPI_GenTimerGetCompare());
+	uint32_t elapsed = (uint32_t)((uint64_t)counts * 1000 / local_counts_per_ms);
+
+	return RPI_GetSystemTimer()->counter_lo - elapsed;
+}
+
+static void stop_local_tick(int core)
+{
+	RPI_GenTimerSetControl(RPI_GENTIMER_CTL_IMASK);
+	irq_disable(IRQ_LOCAL_CNTPNS);
+	local_interval[core] = 0;
+}
+
+/** @brief Moves the tick between the IRQ path and the FIQ fast path. See
+ * fiq_route() for when to call it. Only applies to the ARM timer tick.
+ * @return 0, or -1 if the FIQ is taken by another source
+ */
+int kernel_tick_fiq(int on)
+{
+	if (on)
+	{
+		irq_register(IRQ_LOCAL_MAILBOX(0), tick_kick, NULL);
+		if (fiq_route(IRQ_ARM_TIMER, tick_fiq) != 0)
+		{
+			irq_register(IRQ_LOCAL_MAILBOX(0), NULL, NULL);
+			return -1;
+		}
+	}
+	else if (tick_fiq_on)
+	{
+		fiq_unroute();
+		irq_register(IRQ_LOCAL_MAILBOX(0), NULL, NULL);
+		irq_register(IRQ_ARM_TIMER, tick_irq, NULL);
+	}
+	tick_fiq_on = on;
+	return 0;
+}
+
+/** @brief Counts APB cycles over CALIBRATION_US system timer microseconds.
+ * The free running counter is not prescaled, so it wraps after about ten
+ * seconds at the highest core clock, far more than the measurement.
+ */
+static uint32_t measure_apb_hz(void)
+{
+	rpi_arm_timer_t *at = RPI_GetArmTimer();
+	rpi_sys_timer_t *st = RPI_GetSystemTimer();
+
+	// Preemption only stretches the interval, both counters keep running
+	at->Control |= RPI_ARMTIMER_CTRL_FRC_ENABLE;
+	at->Control &= ~RPI_ARMTIMER_CTRL_FRC_PRESCALE(0xFF);
+
+	uint32_t t0 = st->counter_lo;
+	while (st->counter_lo == t0)
+		;
+	uint32_t c0 = at->FreeRunningCounter;
+	t0++;
+	while (st->counter_lo - t0 < CALIBRATION_US)
+		;
+	uint32_t c1 = at->FreeRunningCounter;
+
+	return (uint32_t)((uint64_t)(c1 - c0) * 1000000 / CALIBRATION_US);
+}
+
+/** @brief Reads the APB clock rate from the mailbox and checks it against
+ * the system timer, which busy-waits CALIBRATION_US.
+ * @return the rate in Hz, also kept for kernel_apb_hz()
+ */
+static uint32_t calibrate_apb_hz(void)
+{
+	uint32_t reported = RPI_GetClockRate(RPI_CLOCK_CORE);
+	uint32_t measured = measure_apb_hz();
+	uint32_t diff;
+
+	if (reported == 0)
+		reported = DEFAULT_APB_HZ;
+	diff = reported > measured ? reported - measured : measured - reported;
+
+	apb_hz = (uint64_t)diff * 1000000 / reported > TICK_TOLERANCE_PPM ? measured : reported;
+	return apb_hz;
+}
+
+/** @return the APB clock rate in Hz found by the last kernel_set_tick_hz(),
+ * 0 before
+ */
+uint32_t kernel_apb_hz(void)
+{
+	return apb_hz;
+}
+
+/** @brief Programs the ARM timer for a periodic tick and enables its IRQ.
+ * The PreDivider is kept as small as possible, for the finest Load.
+ * @param hz is the tick rate, e.g., 1000 for a 1 ms tick
+ * @return 0 if the tick period is within TICK_TOLERANCE_PPM of 1/hz, -1
+ * if the rate cannot be reached that closely, in which case the nearest
+ * rate is programmed
+ */
+int kernel_set_tick_hz(uint32_t hz)
+{
+	rpi_arm_timer_t *at = RPI_GetArmTimer();
+	uint32_t clk = calibrate_apb_hz();
+	uint64_t cycles, actual_ns, wanted_ns, err;
+	uint32_t prediv, load;
+
+	if (hz == 0)
+		return -1;
+	if (RPI_GetCoreId() == 0 && local_interval[0] != 0)
+		stop_local_tick(0);
+
+	// timer_clock = apb_clock / (PreDivider + 1), period = Load + 1 counts
+	cycles = ((uint64_t)clk + hz / 2) / hz;
+	prediv = (uint32_t)((cycles - 1) / (RPI_ARMTIMER_MAX_LOAD + 1));
+	if (prediv > RPI_ARMTIMER_MAX_PREDIVIDER)
+		prediv = RPI_ARMTIMER_MAX_PREDIVIDER;
+	load = (uint32_t)((cycles + (prediv + 1) / 2) / (prediv + 1));
+	if (load > RPI_ARMTIMER_MAX_LOAD + 1)
+		load = RPI_ARMTIMER_MAX_LOAD + 1;
+	if (load < 2)
+		load = 2;
+	load--;
+
+	at->Control = RPI_ARMTIMER_CTRL_DISABLE;
+	at->PreDivider = prediv;
+	at->Load = load;
+	at->IRQClear = 1;
+	at->Control =
+		RPI_ARMTIMER_CTRL_23BIT |
+		RPI_ARMTIMER_CTRL_ENABLE |
+		RPI_ARMTIMER_CTRL_INT_ENABLE |
+		RPI_ARMTIMER_CTRL_PRESCALE_1;
+	arm_counts_per_ms = clk / (prediv + 1) / 1000;
+	if (arm_counts_per_ms == 0)
+		arm_counts_per_ms = 1;
+	irqstat_set_expiry(IRQ_ARM_TIMER, tick_expiry);
+	if (!tick_fiq_on)
+		irq_register(IRQ_ARM_TIMER, tick_irq, NULL);
+
+	actual_ns = (uint64_t)(prediv + 1) * (load + 1) * 1000000000 / clk;
+	wanted_ns = 1000000000 / hz;
+	tick_ns = (uint32_t)actual_ns;
+
+	err = actual_ns > wanted_ns ? actual_ns - wanted_ns : wanted_ns - actual_ns;
+	return err * 1000000 / wanted_ns > TICK_TOLERANCE_PPM ? -1 : 0;
+}
+
+/** @brief Drives the tick of the calling core from its generic timer.
+ * On core 0 this replaces the ARM timer tick, the other cores can only
+ * have this one.
+ * @param hz is the tick rate, or 0 to stop the tick of the core
+ * @return 0 if the tick period is within TICK_TOLERANCE_PPM of 1/hz, -1
+ * otherwise, in which case the nearest rate is programmed
+ */
+int kernel_set_local_tick_hz(uint32_t hz)
+{
+	int core = RPI_GetCoreId();
+	uint32_t clk = RPI_GenTimerFrequency();
+	uint64_t actual_ns, wanted_ns, err;
+	uint32_t interval;
+	irqflags_t flags;
+
+	if (hz == 0)
+	{
+		stop_local_tick(core);
+		return 0;
+	}
+	if (core == 0)
+	{
+		if (tick_fiq_on)
+			kernel_tick_fiq(0);
+		RPI_GetArmTimer()->Control = RPI_ARMTIMER_CTRL_DISABLE;
+		irq_register(IRQ_ARM_TIMER, NULL, NULL);
+	}
+
+	interval = (clk + hz / 2) / hz;
+	if (interval == 0)
+		interval = 1;
+
+	local_counts_per_ms = clk / 1000;
+	if (local_counts_per_ms == 0)
+		local_counts_per_ms = 1;
+	irqstat_set_expiry(IRQ_LOCAL_CNTPNS, local_tick_expiry);
+
+	flags = irqsave();
+	local_interval[core] = interval;
+	RPI_GenTimerSetCompare(RPI_GenTimerCount() + interval);
+	RPI_GenTimerSetControl(RPI_GENTIMER_CTL_ENABLE);
+	irq_register(IRQ_LOCAL_CNTPNS, local_tick_irq, NULL);
+	irqrestore(flags);
+
+	actual_ns = (uint64_t)interval * 1000000000 / clk;
+	wanted_ns = 1000000000 / hz;
+	local_tick_ns[core] = (uint32_t)actual_ns;
+
+	err = actual_ns > wanted_ns ? actual_ns - wanted_ns : wanted_ns - actual_ns;
+	return err * 1000000 / wanted_ns > TICK_TOLERANCE_PPM ? -1 : 0;
+}
+
+/** @return the period of the tick of the calling core in nanoseconds, 0
+ * before kernel_set_tick_hz() or kernel_set_local_tick_hz()
+ */
+uint32_t kernel_tick_ns(void)
+{
+	int core = RPI_GetCoreId();
+
+	return local_interval[core] != 0 ? local_tick_ns[core] : tick_ns;
+}
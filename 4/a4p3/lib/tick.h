@@ -0,0 +1,20 @@
+/*
+ * Kernel tick from the ARM timer, calibrated against the system timer, or
+ * from the generic timer of each core.
+ */
+
+#ifndef _TICK_H
+#define _TICK_H
+
+#include <stdint.h>
+
+/* Largest relative error of the tick period accepted by kernel_set_tick_hz() */
+#define TICK_TOLERANCE_PPM 1000
+
+int kernel_set_tick_hz(uint32_t hz);
+uint32_t kernel_tick_ns(void);
+uint32_t kernel_apb_hz(void);
+int kernel_tick_fiq(int on);
+int kernel_set_local_tick_hz(uint32_t hz);
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * Software timers for TinyThreads.
+ *
+ * Active timers are kept in a binary min-heap ordered by expiry time. The
+ * timer thread blocks with the earliest expiry as timeout, so the tick only
+ * has to look at the head of the kernel's timeout queue and no timer is
+ * scanned per tick.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "timer.h"
+#include "tinythreads.h"
+#include "rpi-interrupts.h"
+#include "rpi-systimer.h"
+
+struct swtimer
+{
+	void (*callback)(int); // NULL while the timer is free
+	int arg;
+	uint64_t expiry;	   // Absolute time in microseconds
+	uint64_t period;	   // 0 for one-shot timers
+	int pos;			   // Index in heap, -1 while not active
+};
+
+static struct swtimer timers[NTIMERS];
+// @brief Active timers, heap[0] expires first.
+static struct swtimer *heap[NTIMERS];
+static int nheap = 0;
+
+// @brief The timer thread waits here for the next expiry or a new timer.
+static thread timerQ = NULL;
+static int started = 0;
+
+static void heap_swap(int i, int j)
+{
+	struct swtimer *t = heap[i];
+
+	heap[i] = heap[j];
+	heap[j] = t;
+	heap[i]->pos = i;
+	heap[j]->pos = j;
+}
+
+static void sift_up(int i)
+{
+	while (i > 0 && heap[(i - 1) / 2]->expiry > heap[i]->expiry)
+	{
+		heap_swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void sift_down(int i)
+{
+	while (1)
+	{
+		int min = i;
+		int l = 2 * i + 1;
+		int r = 2 * i + 2;
+
+		if (l < nheap && heap[l]->expiry < heap[min]->expiry)
+			min = l;
+		if (r < nheap && heap[r]->expiry < heap[min]->expiry)
+			min = r;
+		if (min == i)
+			return;
+		heap_swap(i, min);
+		i = min;
+	}
+}
+
+static void heap_insert(struct swtimer *t)
+{
+	t->pos = nheap;
+	heap[nheap++] = t;
+	sift_up(t->pos);
+}
+
+static void heap_remove(struct swtimer *t)
+{
+	int i = t->pos;
+
+	nheap--;
+	if (i != nheap)
+	{
+		heap[i] = heap[nheap];
+		heap[i]->pos = i;
+		sift_down(i);
+		sift_up(i);
+	}
+	t->pos = -1;
+}
+
+/** @brief Waits for the earliest timer to expire and runs its callback with
+ * IRQs unmasked. Periodic timers are re-inserted before their callback runs.
+ */
+static void timer_thread(int arg)
+{
+	while (1)
+	{
+		irqflags_t flags = irqsave();
+
+		while (nheap == 0 || heap[0]->expiry > RPI_GetTimeMicroSeconds())
+			wait_on(&timerQ, nheap == 0 ? NO_DEADLINE : heap[0]->expiry);
+
+		struct swtimer *t = heap[0];
+		void (*callback)(int) = t->callback;
+		int cbarg = t->arg;
+
+		heap_remove(t);
+		if (t->period != 0)
+		{
+			t->expiry += t->period;
+			heap_insert(t);
+		}
+		else
+		{
+			t->callback = NULL;
+		}
+
+		irqrestore(flags);
+		callback(cbarg);
+	}
+}
+
+/** @brief Starts a timer that first expires at an absolute time.
+ * @param callback is called in the timer thread with arg
+ * @param expiry is an absolute time in microseconds
+ * @param period is the period in microseconds, 0 for a one-shot timer
+ * @return the timer id, -1 if all NTIMERS timers are in use or callback
+ * is NULL
+ */
+int timer_start_at(void (*callback)(int), int arg, uint64_t expiry, uint64_t period)
+{
+	int id = -1;
+	irqflags_t flags;
+
+	if (callback == NULL) // NULL marks a free timer
+		return -1;
+
+	flags = irqsave();
+
+	if (!started)
+	{
+		spawnService(timer_thread, 0);
+		started = 1;
+	}
+
+	for (int i = 0; i < NTIMERS; i++)
+	{
+		if (timers[i].callback == NULL)
+		{
+			id = i;
+			break;
+		}
+	}
+
+	if (id >= 0)
+	{
+		struct swtimer *t = &timers[id];
+
+		t->callback = callback;
+		t->arg = arg;
+		t->expiry = expiry;
+		t->period = period;
+		heap_insert(t);
+		// The timer thread recomputes its timeout if this one is earlier
+		if (t->pos == 0)
+			wake_one(&timerQ);
+	}
+
+	irqrestore(flags);
+	return id;
+}
+
+/** @brief Starts a timer that first expires after delay microseconds.
+ * @see timer_start_at()
+ */
+int timer_start(void (*callback)(int), int arg, uint64_t delay, uint64_t period)
+{
+	return timer_start_at(callback, arg, RPI_GetTimeMicroSeconds() + delay, period);
+}
+
+/** @brief Stops a timer. Stopping a one-shot timer that already expired
+ * has no effect, as long as its id has not been reused, and so has an id
+ * that timer_start() did not return, e.g., -1.
+ */
+void timer_stop(int id)
+{
+	irqflags_t flags;
+	struct swtimer *t;
+
+	if (id < 0 || id >= NTIMERS)
+		return;
+
+	flags = irqsave();
+	t = &timers[id];
+
+	if (t->callback != NULL)
+	{
+		if (t->pos >= 0)
+			heap_remove(t);
+		t->callback = NULL;
+	}
+
+	irqrestore(flags);
+}
@@ -0,0 +1,18 @@
+/*
+ * Software timers for TinyThreads.
+ * One-shot and periodic callbacks that run in a dedicated high priority
+ * timer thread, not in interrupt context.
+ */
+
+#ifndef _TIMER_H
+#define _TIMER_H
+
+#include <stdint.h>
+
+#define NTIMERS 16
+
+int timer_start(void (*callback)(int), int arg, uint64_t delay, uint64_t period);
+int timer_start_at(void (*callback)(int), int arg, uint64_t expiry, uint64_t period);
+void timer_stop(int id);
+
+#endif
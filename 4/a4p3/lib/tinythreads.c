@@ -7,10 +7,11 @@
  */
 
 #include <setjmp.h>
+#include <reent.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
-#include <limits.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "tinythreads.h"
@@ -18,30 +19,28 @@
 #include "uart.h"
 #include "piface.h"
 #include "rpi-systimer.h"
+#include "latency.h"
+#include "fastcode.h"
+#include "cyclic.h"
+#include "hrtimer.h"
+#include "irqstat.h"
 
 /*----------------------------------------------------------------------------
   Constants
  *----------------------------------------------------------------------------*/
-#define STACKSIZE 1024
-#define NTHREADS 5
+#define STACKSIZE 2048 // Also holds the frame of irq_entry when preempted
+#define NTHREADS 8
+#define DEFAULT_QUANTUM_US 0 // Round Robin rotates on every tick
+#define SERVICE_DEADLINE 0 // Deadline and period of service threads, ahead of any other thread
+#ifndef BATCH_RELEASE
+#define BATCH_RELEASE 1 // 0 releases periodic jobs one enqueue() at a time, see make RELEASE=item
+#endif
 // #define NULL 		0
 
 /*----------------------------------------------------------------------------
   Internal References and Macros
  *----------------------------------------------------------------------------*/
 
-__attribute__((always_inline)) static inline void enable()
-{
-	__asm volatile("CPSIE  i \n"); // Clear PRIMASK
-}
-
-__attribute__((always_inline)) static inline void disable()
-{
-	__asm volatile("cpsid i \n"); // set PRIMASK
-}
-
-#define DISABLE() disable()
-#define ENABLE() enable()
 #define SETSTACK(buf, a) *((unsigned int *)(buf) + 8) = (unsigned int)(a) + STACKSIZE - 4;
 
 /*----------------------------------------------------------------------------
@@ -53,26 +52,66 @@ struct thread_block
 	void (*function)(int);			  // Code to run, i.e. the routine to run
 	int arg;						  // Argument to the above
 	thread next;					  // For use in linked lists
+	thread prev;					  // Previous element, NULL at the head
+	thread *queue;					  // Queue the thread is in, NULL if none
 	jmp_buf context;				  // Machine state
 	char stack[STACKSIZE];			  // Execution stack space
-	unsigned int Period_Deadline;	  // Absolute Period and Deadline of the thread
-	unsigned int Rel_Period_Deadline; // Relative Period and Deadline of the thread
+	uint64_t Period_Deadline;		  // Absolute Period and Deadline of the thread in microseconds
+	uint64_t Rel_Period_Deadline;	  // Relative Period and Deadline of the thread in microseconds
+	uint64_t Threshold;				  // Only threads with a shorter Rel_Period_Deadline preempt this one
+	unsigned int quantum;			  // Round Robin time slice in microseconds
+	unsigned int budget;			  // Microseconds left of the current time slice
+	unsigned int slice_start;		  // System timer when budget was last charged
+	thread tnext;					  // For use in timeoutQ
+	thread tprev;					  // Previous element in timeoutQ
+	uint64_t wake_time;				  // Absolute timeout while blocked in timeoutQ
+	int wait_result;				  // WAIT_OK or WAIT_TIMEOUT, see wait_on()
+	void *wait_data;				  // Passed by wait_on_data() to wake_matching()
+	struct _reent *reent;			  // newlib state installed as _impure_ptr by dispatch()
+	struct _reent reent_data;		  // Storage for the above, unused by the main thread
 };
 
 struct thread_block threads[NTHREADS];
 struct thread_block initp;
+// @brief Runs whenever no other thread is ready, never in readyQ.
+static struct thread_block idlep;
 
 // @brief Points to a queue of free thread_block instances/element in the threads array.
-thread freeQ = threads;
+thread freeQ = NULL; // Filled by initialize()
 // @brief Points to a queue of thread_block instances in the threads array that are ready to execute.
 thread readyQ = NULL;
 // @brief Points to a queue of thread_block instances in the threads array that have finished execution
 thread doneQ = NULL;
+// @brief Points to a queue of blocked threads with a timeout, sorted by wake_time.
+static thread timeoutQ = NULL;
 
 thread current = &initp;
 
 int initialized = 0;
 
+// @brief Scheduling policy applied on every tick, see set_scheduler().
+static int policy = SCHED_EDF;
+
+// @brief Set by interrupt handlers, consumed on the IRQ exit path.
+static volatile int reschedule_pending = 0;
+// @brief Set from irq_enter() until the end of irq_exit(), see in_interrupt().
+static volatile int in_irq = 0;
+
+// @brief Fires at the next timeout or periodic release, between ticks.
+static hrtimer wakeup_timer = HRTIMER_INIT;
+
+static void arm_thread(thread t);
+static void enqueue(thread p, thread *queue);
+static void reschedule(void);
+
+/** @brief Routine of the idle thread, sleeps until the next interrupt.
+ */
+static void idle(int arg)
+{
+	while (1)
+		__asm volatile("wfi \n");
+}
+
 /** @brief Initializes each thread in the threads array.
  * For each thread in the threads array, a unique identifier is assigned
  * along with the task information.
@@ -83,67 +122,108 @@ void initialize(void)
 	initp.function = NULL;
 	initp.arg = -1;
 	initp.next = NULL;
-	initp.Period_Deadline = INT_MAX;
-	initp.Rel_Period_Deadline = INT_MAX;
-
+	initp.prev = NULL;
+	initp.queue = NULL;
+	initp.Period_Deadline = NO_DEADLINE;
+	initp.Rel_Period_Deadline = NO_DEADLINE;
+	initp.Threshold = NO_THRESHOLD;
+	initp.quantum = DEFAULT_QUANTUM_US;
+	initp.budget = DEFAULT_QUANTUM_US;
+	initp.tnext = NULL;
+	initp.tprev = NULL;
+	initp.reent = _impure_ptr; // The main thread keeps newlib's global state
+
+	freeQ = NULL;
 	for (int i = 0; i < NTHREADS; i++)
 	{
 		threads[i].idx = i;
 		threads[i].function = NULL;
 		threads[i].arg = -1;
-		threads[i].next = &threads[i + 1];
-		threads[i].Period_Deadline = INT_MAX;
-		threads[i].Rel_Period_Deadline = INT_MAX;
+		threads[i].Period_Deadline = NO_DEADLINE;
+		threads[i].Rel_Period_Deadline = NO_DEADLINE;
+		threads[i].Threshold = NO_THRESHOLD;
+		threads[i].quantum = DEFAULT_QUANTUM_US;
+		threads[i].budget = DEFAULT_QUANTUM_US;
+		threads[i].tnext = NULL;
+		threads[i].tprev = NULL;
+		_REENT_INIT_PTR(&threads[i].reent_data);
+		threads[i].reent = &threads[i].reent_data;
+		enqueue(&threads[i], &freeQ);
 	}
-	threads[NTHREADS - 1].next = NULL;
+
+	idlep.idx = -2;
+	idlep.function = idle;
+	idlep.arg = -1;
+	idlep.next = NULL;
+	idlep.prev = NULL;
+	idlep.queue = NULL;
+	idlep.Period_Deadline = NO_DEADLINE;
+	idlep.Rel_Period_Deadline = NO_DEADLINE;
+	idlep.Threshold = NO_THRESHOLD;
+	idlep.quantum = DEFAULT_QUANTUM_US;
+	idlep.budget = DEFAULT_QUANTUM_US;
+	idlep.tnext = NULL;
+	idlep.tprev = NULL;
+	_REENT_INIT_PTR(&idlep.reent_data);
+	idlep.reent = &idlep.reent_data;
+	arm_thread(&idlep);
+
 	initialized = 1;
 }
 
-/** @brief Adds an element to the tail of the queue
- * @note In Assignment 4, parts 2 and 3, you might want to change this
- * implementation to enqueue with insertion sort.
+/** @brief Adds an element to the queue, sorted by deadline, after the
+ * elements with the same deadline.
+ * Queues are doubly linked and each element knows the queue it is in, so
+ * dequeueItem() removes any element in constant time.
  */
-static void enqueue(thread p, thread *queue)
+static void __fastcode enqueue(thread p, thread *queue)
 {
-	p->next = NULL;
+	thread q = NULL;
+	thread n = *queue;
 
-	if (*queue == NULL)
+	while (n &&
+		   (n->Period_Deadline < p->Period_Deadline ||
+			(n->Period_Deadline == p->Period_Deadline &&
+			 n->Rel_Period_Deadline <= p->Rel_Period_Deadline)))
 	{
-		*queue = p;
-		return;
+		q = n;
+		n = n->next;
 	}
 
-	if ((*queue)->Period_Deadline > p->Period_Deadline ||
-		((*queue)->Period_Deadline == p->Period_Deadline &&
-		 (*queue)->Rel_Period_Deadline > p->Rel_Period_Deadline))
-	{
-		p->next = *queue;
+	p->queue = queue;
+	p->prev = q;
+	p->next = n;
+	if (n)
+		n->prev = p;
+	if (q)
+		q->next = p;
+	else
 		*queue = p;
-		return;
-	}
-
-	thread q = *queue;
-
-	while (q->next &&
-		   (q->next->Period_Deadline < p->Period_Deadline ||
-			(q->next->Period_Deadline == p->Period_Deadline &&
-			 q->next->Rel_Period_Deadline <= p->Rel_Period_Deadline)))
-	{
-		q = q->next;
-	}
+}
 
-	p->next = q->next;
-	q->next = p;
+/** @brief Removes a specific element from the queue it is in.
+ */
+static void __fastcode dequeueItem(thread t)
+{
+	if (t->prev)
+		t->prev->next = t->next;
+	else
+		*t->queue = t->next;
+	if (t->next)
+		t->next->prev = t->prev;
+	t->next = NULL;
+	t->prev = NULL;
+	t->queue = NULL;
 }
 
 /** @brief Remove an element from the head of the queue
  */
-static thread dequeue(thread *queue)
+static thread __fastcode dequeue(thread *queue)
 {
 	thread p = *queue;
-	if (*queue)
+	if (p)
 	{
-		*queue = (*queue)->next;
+		dequeueItem(p);
 	}
 	else
 	{
@@ -155,66 +235,214 @@ static thread dequeue(thread *queue)
 	return p;
 }
 
+/** @brief Finds the ready thread with the shortest period, the one with
+ * the earliest deadline among equal periods. readyQ must not be empty.
+ */
+static thread __fastcode shortest_period(void)
+{
+	thread p = readyQ;
+
+	for (thread t = readyQ->next; t != NULL; t = t->next)
+		if (t->Rel_Period_Deadline < p->Rel_Period_Deadline)
+			p = t;
+	return p;
+}
+
+/** @brief Removes the thread to run next from readyQ, its head or, under
+ * SCHED_RM, the thread with the shortest period. Falls back on the idle
+ * thread if no thread is ready.
+ */
+static thread __fastcode next_ready(void)
+{
+	thread p;
+
+	if (readyQ == NULL)
+		return &idlep;
+	p = policy == SCHED_RM ? shortest_period() : readyQ;
+	dequeueItem(p);
+	return p;
+}
+
+/** @brief Charges the time the current thread has run since it was
+ * dispatched, or last charged, to its time slice budget.
+ * @return the remaining budget in microseconds
+ */
+static unsigned int __fastcode charge_budget(void)
+{
+	unsigned int now = RPI_GetSystemTimer()->counter_lo;
+	unsigned int elapsed = now - current->slice_start;
+
+	current->budget = current->budget > elapsed ? current->budget - elapsed : 0;
+	current->slice_start = now;
+	return current->budget;
+}
+
+static void wakeup(int arg)
+{
+	pend_reschedule();
+}
+
+/** @brief Arms wakeup_timer for the earliest timeout in timeoutQ, release
+ * in doneQ or, under SCHED_TT, minor frame start, so that the scheduler
+ * runs at that time to the microsecond instead of at the next tick. Must
+ * be called with IRQs masked.
+ */
+static void arm_wakeup(void)
+{
+	uint64_t next = NO_DEADLINE;
+
+	if (timeoutQ != NULL)
+		next = timeoutQ->wake_time;
+	if (doneQ != NULL && doneQ->Period_Deadline < next)
+		next = doneQ->Period_Deadline;
+	if (policy == SCHED_TT && cyclic_next_frame() < next)
+		next = cyclic_next_frame();
+
+	if (next == NO_DEADLINE)
+		hrtimer_cancel(&wakeup_timer);
+	else if (!wakeup_timer.active || wakeup_timer.expiry != next)
+		hrtimer_start(&wakeup_timer, next, wakeup, 0);
+}
+
 /** @brief Starts or resumes the execution of the thread
  * select to execute.
  */
-static void dispatch(thread next)
+static void __fastcode dispatch(thread next)
 {
 	if (next != NULL)
 	{
+		// Lives on this thread's stack, a thread may be switched out on the IRQ exit path
+		int irq_context = in_irq;
+
 		if (setjmp(current->context) == 0)
 		{
 			current = next;
+			current->slice_start = RPI_GetSystemTimer()->counter_lo;
+			_impure_ptr = current->reent;
 			longjmp(next->context, 1);
 		}
+		in_irq = irq_context;
+		LATENCY_RESUME_STAMP();
 	}
 }
 
-/** @brief Creates an thread block instance and assign to it an start routine,
- * i.e., the procedure that the thread will execute.
- * @param function is a pointer to the start routine
- * @param int arg is the parameter to the start routine
+/** @brief Runs the start routine of the current thread and parks the thread
+ * when the routine returns. Periodic threads wait in doneQ for their next
+ * release, one-shot threads go back to freeQ.
+ * @note Executes on the thread's own stack and never returns.
  */
-void spawn(void (*function)(int), int arg)
+static void __attribute__((noreturn)) thread_body(void)
+{
+	in_irq = 0;
+	LATENCY_RESUME_STAMP();
+	irqrestore(IRQ_UNMASKED); // Ends the irqsave() of the dispatching thread
+	current->function(current->arg);
+	irqsave();
+
+	if (current->Rel_Period_Deadline != NO_DEADLINE && current->Rel_Period_Deadline != SERVICE_DEADLINE)
+	{
+		enqueue(current, &doneQ); // Move to doneQ for periodic tasks
+		arm_wakeup();
+	}
+	else
+	{
+		enqueue(current, &freeQ); // Move to freeQ for one-shot tasks
+	}
+	dispatch(next_ready());
+
+	// Never resumed, the thread is re-armed before it runs again
+	while (1)
+		;
+}
+
+/** @brief Prepares the context of a thread so that the next dispatch
+ * starts its routine from the top of its own stack.
+ */
+static void arm_thread(thread t)
+{
+	if (setjmp(t->context) == 1)
+		thread_body();
+	SETSTACK(&t->context, &t->stack);
+}
+
+/** @brief Takes a thread block from freeQ, sets it up for a start routine
+ * and makes it ready. Every field a previous thread may have changed is
+ * reset here, for all spawn functions. Must be called with IRQs masked.
+ */
+static void spawn_thread(void (*function)(int), int arg, uint64_t deadline, uint64_t rel_deadline,
+						 uint64_t threshold, unsigned int quantum)
 {
 	thread newp;
-	DISABLE();
+
 	if (!initialized)
 		initialize();
 	newp = dequeue(&freeQ);
+	// Free the stdio buffers and heap state of a previous thread, then reset errno and the rest
+	_reclaim_reent(&newp->reent_data);
+	_REENT_INIT_PTR(&newp->reent_data);
 	newp->function = function;
 	newp->arg = arg;
-	newp->next = NULL;
-	newp->Period_Deadline = INT_MAX;
-	newp->Rel_Period_Deadline = INT_MAX;
+	newp->Period_Deadline = deadline;
+	newp->Rel_Period_Deadline = rel_deadline;
+	newp->Threshold = threshold;
+	newp->quantum = quantum;
+	newp->budget = quantum;
+
+	arm_thread(newp);
+	enqueue(newp, &readyQ);
+}
 
-	if (setjmp(newp->context) == 1)
+/** @brief Creates an thread block instance and assign to it an start routine,
+ * i.e., the procedure that the thread will execute.
+ * @param function is a pointer to the start routine
+ * @param int arg is the parameter to the start routine
+ */
+void spawn(void (*function)(int), int arg)
+{
+	spawnWithQuantum(function, arg, DEFAULT_QUANTUM_US);
+}
+
+/** @brief Creates a thread like spawn() with its own Round Robin time slice.
+ * @param function is a pointer to the start routine
+ * @param int arg is the parameter to the start routine
+ * @param quantum is the time slice in microseconds. The thread is only
+ * rotated out by the tick once it has used up its slice; 0 rotates on
+ * every tick.
+ */
+void spawnWithQuantum(void (*function)(int), int arg, unsigned int quantum)
+{
+	irqflags_t flags = irqsave();
+
+	spawn_thread(function, arg, NO_DEADLINE, NO_DEADLINE, NO_THRESHOLD, quantum);
+	irqrestore(flags);
+}
+
+/** @brief Switches from the current thread to a thread in readyQ, which
+ * takes the current thread's place. Must be called with IRQs masked.
+ */
+static void __fastcode switch_to(thread p)
+{
+	dequeueItem(p);
+	if (current != &idlep)
 	{
-		ENABLE();
-		current->function(current->arg);
-		DISABLE();
-		enqueue(current, &freeQ);
-		current = NULL;
-		dispatch(dequeue(&readyQ));
+		if (charge_budget() == 0)
+			current->budget = current->quantum;
+		enqueue(current, &readyQ);
 	}
-	SETSTACK(&newp->context, &newp->stack);
-	enqueue(newp, &readyQ);
-	ENABLE();
+	dispatch(p);
 }
 
 /** @brief Preempts the execution of the current thread and a new
  * thread gets to run.
+ * The time used so far is charged to the thread's time slice, and the
+ * rest of the slice is kept for when the thread runs again.
  */
-void yield(void)
+void __fastcode yield(void)
 {
-	DISABLE();
+	irqflags_t flags = irqsave();
 	if (readyQ != NULL)
-	{
-		thread p = dequeue(&readyQ);
-		enqueue(current, &readyQ);
-		dispatch(p);
-	}
-	ENABLE();
+		switch_to(readyQ);
+	irqrestore(flags);
 }
 
 /** @brief Sets the locked flag of the mutex if it was previously unlocked,
@@ -225,7 +453,7 @@ void lock(mutex *m)
 {
 	// To be implemented in Assignment 4!!!
 
-	DISABLE();
+	irqflags_t flags = irqsave();
 
 	if (m->locked == 0)
 	{
@@ -233,11 +461,11 @@ void lock(mutex *m)
 	}
 	else
 	{
-		enqueue(current, &m->waitQ);
-		dispatch(dequeue(&readyQ));
+		// unlock() hands the mutex over without clearing the locked flag
+		wait_on(&m->waitQ, NO_DEADLINE);
 	}
 
-	ENABLE();
+	irqrestore(flags);
 }
 
 /** @brief Activate a thread in the waiting queue of the mutex if it is
@@ -247,235 +475,684 @@ void unlock(mutex *m)
 {
 	// To be implemented in Assignment 4!!!
 
-	DISABLE();
+	irqflags_t flags = irqsave();
 
 	if (m->waitQ != NULL)
 	{
-		thread p = dequeue(&m->waitQ);
-		enqueue(p, &readyQ);
+		wake_one(&m->waitQ);
 	}
 	else
 	{
 		m->locked = 0;
 	}
 
-	ENABLE();
+	irqrestore(flags);
 }
 
 /** @brief Creates an thread block instance and assign to it an start routine,
  * i.e., the procedure that the thread will execute.
  * @param function is a pointer to the start routine
  * @param int arg is the parameter to the start routine
+ * @param deadline is the absolute deadline of the first job, in microseconds
+ * of the system timer, see RPI_GetTimeMicroSeconds()
+ * @param rel_deadline is the period and relative deadline in microseconds,
+ * or NO_DEADLINE for a one-shot thread
  */
-void spawnWithDeadline(void (*function)(int), int arg, unsigned int deadline, unsigned int rel_deadline)
+void spawnWithDeadline(void (*function)(int), int arg, uint64_t deadline, uint64_t rel_deadline)
 {
 	// To be implemented in Assignment 4!!!
 
-	thread newp;
-	DISABLE();
+	spawnWithThreshold(function, arg, deadline, rel_deadline, NO_THRESHOLD);
+}
 
-	if (!initialized)
-		initialize();
-	newp = dequeue(&freeQ);
-	newp->function = function;
-	newp->arg = arg;
-	newp->next = NULL;
-	newp->Period_Deadline = deadline;
-	newp->Rel_Period_Deadline = rel_deadline;
+/** @brief Creates a thread like spawnWithDeadline() with a preemption
+ * threshold. While the thread runs, only threads with a relative deadline
+ * shorter than the threshold may preempt it, so threads with relative
+ * deadlines between the two do not preempt each other. See tools/ptgen
+ * for the assignment of thresholds under SCHED_RM; under SCHED_EDF the
+ * thresholds are applied as well, but ptgen's analysis does not cover it.
+ * @param threshold is a relative deadline in microseconds, at most
+ * rel_deadline, or NO_THRESHOLD for a fully preemptive thread
+ */
+void spawnWithThreshold(void (*function)(int), int arg, uint64_t deadline, uint64_t rel_deadline, uint64_t threshold)
+{
+	irqflags_t flags = irqsave();
+
+	spawn_thread(function, arg, deadline, rel_deadline, threshold, DEFAULT_QUANTUM_US);
+	irqrestore(flags);
+}
+
+/** @brief Creates a kernel service thread, e.g., the timer thread, which
+ * runs ahead of every other thread under RM and EDF. Its routine loops
+ * and blocks in wait_on() between requests; it is not periodic, and its
+ * block goes back to freeQ if the routine returns.
+ * @param function is a pointer to the start routine
+ * @param int arg is the parameter to the start routine
+ */
+void spawnService(void (*function)(int), int arg)
+{
+	irqflags_t flags = irqsave();
+
+	spawn_thread(function, arg, SERVICE_DEADLINE, SERVICE_DEADLINE, NO_THRESHOLD, DEFAULT_QUANTUM_US);
+	irqrestore(flags);
+}
 
-	if (setjmp(newp->context) == 1)
+/** @brief Tells if thread a goes before thread b in a deadline ordered queue.
+ */
+static int __fastcode precedes(thread a, thread b)
+{
+	return a->Period_Deadline < b->Period_Deadline ||
+		   (a->Period_Deadline == b->Period_Deadline &&
+			a->Rel_Period_Deadline < b->Rel_Period_Deadline);
+}
+
+/** @brief Sort the elements a given queue container by a given
+ * field or attribute.
+ * Bottom-up merge sort of a list linked through next only, by deadline as
+ * enqueue() does, stable and without recursion or allocation. The prev and
+ * queue links are left to the caller.
+ * https://arxiv.org/abs/2110.01111
+ */
+static void __fastcode sortX(thread *queue)
+{
+	for (int width = 1;; width *= 2)
 	{
-		ENABLE();
-		current->function(current->arg);
-		DISABLE();
+		thread rest = *queue;
+		thread *tail = queue;
+		int merges = 0;
 
-		// When thread finishes, reset its context for next period
-		// Check if it's a periodic task
-		if (current->Rel_Period_Deadline != INT_MAX)
-		{
-			enqueue(current, &doneQ); // Move to doneQ for periodic tasks
-		}
-		else
+		while (rest)
 		{
-			enqueue(current, &freeQ); // Move to freeQ for one-shot tasks
+			thread a = rest;
+			thread b = rest;
+			int na = 0;
+			int nb = width;
+
+			merges++;
+			while (na < width && b)
+			{
+				na++;
+				b = b->next;
+			}
+			while (na > 0 || (nb > 0 && b))
+			{
+				thread t;
+
+				if (na == 0 || (nb > 0 && b && precedes(b, a)))
+				{
+					t = b;
+					b = b->next;
+					nb--;
+				}
+				else
+				{
+					t = a;
+					a = a->next;
+					na--;
+				}
+				*tail = t;
+				tail = &t->next;
+			}
+			rest = b;
 		}
+		*tail = NULL;
+
+		if (merges <= 1)
+			return;
+	}
+}
+
+/** @brief Merges a sorted list, linked through next only, into readyQ in a
+ * single pass. Elements go after the ready threads with the same deadline,
+ * as with enqueue().
+ */
+static void __fastcode merge_ready(thread batch)
+{
+	thread q = NULL;
+	thread n = readyQ;
 
-		thread next = dequeue(&readyQ);
-		if (next)
+	while (batch)
+	{
+		thread p = batch;
+
+		batch = batch->next;
+		while (n && !precedes(p, n))
 		{
-			dispatch(next); // resumes with the new thread
-			ENABLE();
-			return; // finished thread is done
+			q = n;
+			n = n->next;
 		}
 
-		ENABLE();
-		return;
+		p->queue = &readyQ;
+		p->prev = q;
+		p->next = n;
+		if (n)
+			n->prev = p;
+		if (q)
+			q->next = p;
+		else
+			readyQ = p;
+		q = p;
 	}
+}
 
-	SETSTACK(&newp->context, &newp->stack);
-	enqueue(newp, &readyQ);
+// @brief Recursive lock of newlib's malloc, see __malloc_lock().
+static thread malloc_owner = NULL;
+static int malloc_count = 0;
+static thread malloc_waitQ = NULL;
 
-	ENABLE();
+/** @brief Called by newlib before it touches the heap. The lock is
+ * recursive, as malloc may call itself through sbrk or stdio. A thread that
+ * finds it taken blocks instead of masking IRQs for the whole allocation.
+ * @note Interrupt handlers must not allocate memory.
+ */
+void __malloc_lock(struct _reent *r)
+{
+	irqflags_t flags = irqsave();
+
+	if (malloc_count == 0)
+	{
+		malloc_owner = current;
+		malloc_count = 1;
+	}
+	else if (malloc_owner == current)
+	{
+		malloc_count++;
+	}
+	else
+	{
+		// __malloc_unlock() hands the lock over to us
+		wait_on(&malloc_waitQ, NO_DEADLINE);
+	}
+
+	irqrestore(flags);
 }
 
-/** @brief Sort the elements a given queue container by a given
- * field or attribute.
- * https://arxiv.org/abs/2110.01111
+void __malloc_unlock(struct _reent *r)
+{
+	irqflags_t flags = irqsave();
+
+	if (--malloc_count == 0 && malloc_waitQ != NULL)
+	{
+		// Handed over before the waiter is woken, it may run at once
+		malloc_owner = malloc_waitQ;
+		malloc_count = 1;
+		wake_one(&malloc_waitQ);
+	}
+
+	irqrestore(flags);
+}
+
+/** @brief Inserts a blocked thread into timeoutQ, sorted by wake_time.
  */
-static void sortX(thread *queue)
+static void timeout_insert(thread t, uint64_t wake_time)
 {
-	// To be implemented in Assignment 4!!!
+	thread q = NULL;
+	thread n = timeoutQ;
+
+	while (n != NULL && n->wake_time <= wake_time)
+	{
+		q = n;
+		n = n->tnext;
+	}
+
+	t->wake_time = wake_time;
+	t->tprev = q;
+	t->tnext = n;
+	if (n)
+		n->tprev = t;
+	if (q)
+		q->tnext = t;
+	else
+		timeoutQ = t;
 }
 
-/** @brief Removes a specific element from the queue.
+/** @brief Removes a blocked thread from timeoutQ, if it is there.
  */
-static thread dequeueItem(thread *queue, int idx)
+static void __fastcode timeout_remove(thread t)
 {
-	// You might need it in Assignment 4!!!
+	if (t->tprev)
+		t->tprev->tnext = t->tnext;
+	else if (timeoutQ == t)
+		timeoutQ = t->tnext;
+	else
+		return;
+	if (t->tnext)
+		t->tnext->tprev = t->tprev;
+	t->tnext = NULL;
+	t->tprev = NULL;
+}
 
-	thread prev = NULL;
-	thread t = *queue;
+/** @brief Blocks the running thread in a wait queue until it is woken up
+ * by wake_one() or the timeout expires. The queue is kept in deadline order.
+ * Must be called with IRQs masked, from thread context only, so that
+ * callers can test their wait condition and block atomically.
+ * @param waitQ is the wait queue of the kernel object
+ * @param timeout is an absolute time in microseconds, NO_DEADLINE to wait
+ * forever, or NO_WAIT to fail immediately
+ * @return WAIT_OK when woken up, WAIT_TIMEOUT when the timeout expired
+ */
+int wait_on(thread *waitQ, uint64_t timeout)
+{
+	return wait_on_data(waitQ, timeout, NULL);
+}
 
-	while (t)
+/** @brief Same as wait_on(), additionally attaches data describing what the
+ * thread waits for, which is handed to the match function of wake_matching().
+ */
+int wait_on_data(thread *waitQ, uint64_t timeout, void *data)
+{
+	if (!initialized)
+		initialize();
+	if (timeout != NO_DEADLINE && timeout <= RPI_GetTimeMicroSeconds())
+		return WAIT_TIMEOUT;
+
+	current->wait_data = data;
+	current->wait_result = WAIT_OK;
+	enqueue(current, waitQ);
+
+	if (timeout != NO_DEADLINE)
+	{
+		timeout_insert(current, timeout);
+		arm_wakeup();
+	}
+
+	dispatch(next_ready());
+	return current->wait_result;
+}
+
+/** @brief Makes a thread that was removed from its wait queue ready.
+ */
+static void ready_waiter(thread t)
+{
+	timeout_remove(t);
+	t->wait_result = WAIT_OK;
+	enqueue(t, &readyQ);
+}
+
+/** @brief Moves the first thread of a wait queue to readyQ.
+ * Must be called with IRQs masked. In thread context the woken thread
+ * preempts the caller right away if the policy says so, so callers update
+ * their own state first. May be called from interrupt handlers, a
+ * reschedule is then done on the IRQ exit path.
+ * @return the thread that was woken up, or NULL if the queue was empty
+ */
+thread wake_one(thread *waitQ)
+{
+	thread t = dequeue(waitQ);
+
+	if (t != NULL)
+	{
+		ready_waiter(t);
+		reschedule();
+	}
+	return t;
+}
+
+/** @brief Wakes every thread in a wait queue for which match() returns
+ * nonzero, in a single pass over the queue. No woken thread runs before
+ * match() has been called for all of them, see wake_one() for preemption.
+ * Must be called with IRQs masked. May be called from interrupt handlers.
+ * @param match is called with the data the thread passed to wait_on_data()
+ * and with arg
+ * @return the number of threads woken up
+ */
+int wake_matching(thread *waitQ, int (*match)(void *data, void *arg), void *arg)
+{
+	int n = 0;
+	thread t = *waitQ;
+
+	while (t != NULL)
 	{
-		if (t->idx == idx)
+		thread next = t->next;
+
+		if (match(t->wait_data, arg))
 		{
-			if (prev == NULL)
-			{
-				*queue = t->next;
-			}
-			else
-			{
-				prev->next = t->next;
-			}
-			t->next = NULL;
-			return t;
+			dequeueItem(t);
+			ready_waiter(t);
+			n++;
 		}
-		prev = t;
-		t = t->next;
+		t = next;
 	}
-	return NULL;
+	if (n > 0)
+		reschedule();
+	return n;
 }
 
-/** @brief Periodic tasks have to be activated at a given frequency. Their activations are generated by timers .
+// @brief Threads blocked in thread_sleep_until(), only woken by their timeout.
+static thread sleepQ = NULL;
+
+/** @brief Blocks the running thread until an absolute time, other threads
+ * run in the meantime. Returns at once if the time has passed. From thread
+ * context only, also with IRQs masked, e.g., in main before the tick is
+ * started, since the wake-up comes from the high-resolution timer.
+ * @param wake_time is an absolute time in microseconds
  */
-void respawn_periodic_tasks(void)
+void thread_sleep_until(uint64_t wake_time)
 {
-	// To be implemented in Assignment 4!!!
+	irqflags_t flags = irqsave();
 
-	DISABLE();
+	while (wait_on(&sleepQ, wake_time) == WAIT_OK)
+		;
 
-	thread d = doneQ;
+	irqrestore(flags);
+}
 
-	while (d)
+/** @brief Blocks the running thread for a number of microseconds, see
+ * thread_sleep_until(). Use RPI_WaitMicroSeconds() only for hardware delays
+ * shorter than a tick.
+ */
+void thread_sleep_us(uint64_t us)
+{
+	thread_sleep_until(RPI_GetTimeMicroSeconds() + us);
+}
+
+/** @brief Makes all blocked threads whose timeout has expired ready again.
+ */
+static void __fastcode release_timeouts(void)
+{
+	irqflags_t flags = irqsave();
+
+	uint64_t now = RPI_GetTimeMicroSeconds();
+
+	while (timeoutQ != NULL && timeoutQ->wake_time <= now)
 	{
-		if (ticks % d->Period_Deadline == 0)
-		{
-			int idx = d->idx;
+		thread t = timeoutQ;
 
-			d = d->next;
-			thread t = dequeueItem(&doneQ, idx);
+		timeout_remove(t);
+		dequeueItem(t);
+		t->wait_result = WAIT_TIMEOUT;
+		enqueue(t, &readyQ);
+	}
 
-			t->Period_Deadline += t->Rel_Period_Deadline;
+	irqrestore(flags);
+}
 
-			if (setjmp(t->context) == 1)
-			{
-				ENABLE();
-				current->function(current->arg);
-				DISABLE();
+/** @brief Periodic tasks have to be activated at a given frequency. Their activations are generated by timers .
+ * A job is released once the deadline of its previous job has been reached,
+ * which then becomes the start of the new period.
+ */
+void __fastcode respawn_periodic_tasks(void)
+{
+	// To be implemented in Assignment 4!!!
 
-				// Check if it's a periodic task
-				if (current->Rel_Period_Deadline != INT_MAX)
-				{
-					enqueue(current, &doneQ); // Move to doneQ for periodic tasks
-				}
-				else
-				{
-					enqueue(current, &freeQ); // Move to freeQ for one-shot tasks
-				}
+	irqflags_t flags = irqsave();
 
-				thread next = dequeue(&readyQ);
-				if (next)
-				{
-					dispatch(next); // resumes with the new thread
-					ENABLE();
-					return; // finished thread is done
-				}
+	uint64_t now = RPI_GetTimeMicroSeconds();
 
-				ENABLE();
-				return;
-			}
+#if BATCH_RELEASE
+	// doneQ is sorted by deadline, so the jobs due are at its head
+	thread batch = NULL;
 
-			enqueue(t, &readyQ);
-		}
-		else
+	while (doneQ && now >= doneQ->Period_Deadline)
+	{
+		thread t = dequeue(&doneQ);
+
+		t->Period_Deadline += t->Rel_Period_Deadline;
+		arm_thread(t);
+		t->next = batch;
+		batch = t;
+	}
+	sortX(&batch);
+	merge_ready(batch);
+#else
+	thread d = doneQ;
+
+	while (d)
+	{
+		thread t = d;
+
+		d = d->next;
+		if (now >= t->Period_Deadline)
 		{
-			d = d->next;
+			dequeueItem(t);
+			t->Period_Deadline += t->Rel_Period_Deadline;
+
+			arm_thread(t);
+			enqueue(t, &readyQ);
 		}
 	}
+#endif
 
-	ENABLE();
+	irqrestore(flags);
 }
 
 /** @brief Schedules tasks using time slicing
+ * The running thread is rotated to the back of readyQ once its time
+ * slice budget is used up.
  */
-static void scheduler_RR(void)
+static void __fastcode scheduler_RR(void)
 {
 	// To be implemented in Assignment 4!!!
-	DISABLE();
+	irqflags_t flags = irqsave();
 
-	if (readyQ != NULL)
-	{
-		thread p = dequeue(&readyQ);
-		enqueue(current, &readyQ);
-		dispatch(p);
-	}
+	// yield() refills the budget once it is used up
+	if (readyQ != NULL && (current == &idlep || charge_budget() == 0))
+		yield();
 
-	ENABLE();
+	irqrestore(flags);
 }
 
 /** @brief Schedules periodic tasks using Rate Monotonic (RM)
+ * The running thread is preempted by the ready thread with the shortest
+ * period if that period is shorter than the running thread's preemption
+ * threshold, which defaults to its own period. readyQ is sorted by
+ * deadline, not by period, so it is scanned.
  */
-static void scheduler_RM(void)
+static void __fastcode scheduler_RM(void)
 {
 	// To be implemented in Assignment 4!!!
 
 	if (readyQ != NULL)
 	{
-		if (current->Rel_Period_Deadline > readyQ->Rel_Period_Deadline)
-		{
-			yield();
-		}
+		thread t = shortest_period();
+		uint64_t level = current->Threshold < current->Rel_Period_Deadline ?
+							 current->Threshold : current->Rel_Period_Deadline;
+
+		if (current == &idlep || t->Rel_Period_Deadline < level)
+			switch_to(t);
 	}
 }
 
 /** @brief Schedules periodic tasks using Earliest Deadline First  (EDF)
+ * With a preemption threshold, the running thread is only preempted by a
+ * thread with an earlier deadline whose relative deadline is also shorter
+ * than the threshold.
  */
-static void scheduler_EDF(void)
+static void __fastcode scheduler_EDF(void)
 {
 	// To be implemented in Assignment 4!!!
 
-	if (readyQ != NULL)
+	if (current == &idlep)
 	{
-		if (current->Period_Deadline > readyQ->Period_Deadline)
-		{
+		if (readyQ != NULL)
 			yield();
+		return;
+	}
+
+	// The first thread allowed to preempt runs, not the head of readyQ
+	for (thread t = readyQ; t && t->Period_Deadline < current->Period_Deadline; t = t->next)
+	{
+		if (current->Threshold == NO_THRESHOLD || t->Rel_Period_Deadline < current->Threshold)
+		{
+			switch_to(t);
+			break;
 		}
 	}
 }
 
+/** @brief Retires all periodic tasks that are waiting for their next
+ * release, i.e., moves them from doneQ back to freeQ.
+ * @return the number of threads that were retired
+ */
+int retire_periodic_tasks(void)
+{
+	int n = 0;
+
+	irqflags_t flags = irqsave();
+	thread t = dequeue(&doneQ);
+	while (t)
+	{
+		t->Period_Deadline = NO_DEADLINE;
+		t->Rel_Period_Deadline = NO_DEADLINE;
+		enqueue(t, &freeQ);
+		n++;
+		t = dequeue(&doneQ);
+	}
+	irqrestore(flags);
+
+	return n;
+}
+
+/** @brief Changes the absolute deadline of the running thread, which then
+ * competes with that deadline at the next scheduling decision.
+ * Meant for one-shot threads that serve requests with their own deadlines.
+ */
+void set_deadline(uint64_t deadline)
+{
+	current->Period_Deadline = deadline;
+}
+
+/** @brief Changes the absolute deadline of any thread, e.g., of a server
+ * thread blocked for work, before waking it up for work with that
+ * deadline. A thread in a queue keeps its place in deadline order.
+ * Must be called with IRQs masked.
+ */
+void set_thread_deadline(thread t, uint64_t deadline)
+{
+	thread *queue = t->queue;
+
+	if (queue != NULL)
+		dequeueItem(t);
+	t->Period_Deadline = deadline;
+	if (queue != NULL)
+		enqueue(t, queue);
+}
+
+/** @brief Changes the period and relative deadline of any thread, which
+ * is its priority under SCHED_RM, e.g., of a server thread that takes on
+ * work with a shorter period. A thread in a queue keeps its place in
+ * deadline order. Must be called with IRQs masked.
+ */
+void set_thread_period(thread t, uint64_t rel_deadline)
+{
+	thread *queue = t->queue;
+
+	if (queue != NULL)
+		dequeueItem(t);
+	t->Rel_Period_Deadline = rel_deadline;
+	if (queue != NULL)
+		enqueue(t, queue);
+}
+
+/** @return the running thread
+ */
+thread self(void)
+{
+	return current;
+}
+
+/** @brief Lets the policy decide whether a ready thread preempts the
+ * current one. Must be called with IRQs masked.
+ */
+static void __fastcode preempt(void)
+{
+	switch (policy)
+	{
+	case SCHED_RR:
+		scheduler_RR();
+		break;
+	case SCHED_RM:
+		scheduler_RM();
+		break;
+	default:
+		scheduler_EDF();
+		break;
+	}
+}
+
+/** @brief Called after threads have been made ready. In thread context the
+ * policy decides at once, e.g., an unlock() or a mailbox send that readies
+ * an earlier deadline switches to it right away. In interrupt context the
+ * decision is deferred to irq_exit().
+ */
+static void __fastcode reschedule(void)
+{
+	if (in_irq)
+		pend_reschedule();
+	else
+		preempt();
+}
+
+/** @brief Selects the scheduling policy used by scheduler().
+ * @param p is one of SCHED_RR, SCHED_RM or SCHED_EDF, SCHED_TT is set by
+ * cyclic_start()
+ */
+void set_scheduler(int p)
+{
+	irqflags_t flags = irqsave();
+
+	policy = p;
+	arm_wakeup();
+	irqrestore(flags);
+}
+
 /** @brief Calls the actual scheduling mechanisms, i.e., Round Robin,
  * Rate monotonic, or Earliest Deadline First.
  * When dealing with periodic tasks with fixed execution time,
  * it will first call the method that re-spawns period tasks.
  */
-void scheduler(void)
+void __fastcode scheduler(void)
 {
 	// To be implemented in Assignment 4!!!
+	release_timeouts();
 	respawn_periodic_tasks();
-	// scheduler_RR();
-	// scheduler_RM();
-	scheduler_EDF();
+	if (policy == SCHED_TT)
+		cyclic_tick(); // Wakes the frame executor, which then runs by EDF
+	arm_wakeup();
+
+	preempt();
+}
+
+/** @brief Marks a reschedule as pending. Called from interrupt handlers
+ * instead of scheduler(), the switch itself is deferred to irq_exit().
+ */
+void __fastcode pend_reschedule(void)
+{
+	reschedule_pending = 1;
+}
+
+/** @brief Called by interrupt_vector() before the handlers run.
+ */
+void __fastcode irq_enter(void)
+{
+	in_irq = 1;
+}
+
+/** @return nonzero in interrupt handlers and on the IRQ exit path, where
+ * current is the interrupted thread
+ */
+int in_interrupt(void)
+{
+	return in_irq;
+}
+
+/** @brief Runs the scheduler if an interrupt handler asked for it.
+ * Called by irq_entry after interrupt_vector() has returned, in SVC mode on
+ * the stack of the interrupted thread, which at this point already holds the
+ * thread's caller-saved registers and its return address and CPSR. The
+ * remaining registers are saved by dispatch(), so a switch from here
+ * preserves the full interrupted context.
+ */
+void __fastcode irq_exit(void)
+{
+	if (reschedule_pending)
+	{
+		reschedule_pending = 0;
+		scheduler();
+	}
+	in_irq = 0;
+	LATENCY_IRQ_DONE();
+	irq_masked_end();
 }
 
 /** @brief Prints via UART the content of the main variables in TinyThreads
@@ -486,16 +1163,18 @@ void printTinyThreadsUART(void)
 	t = threads;
 	print2uart("\nThreads\n");
 	for (int i = 0; i < NTHREADS; i++)
-		print2uart("t[%i] @%#010x arg: %d idx: %d dl: %d\n", i, &t[i], t[i].arg, t[i].idx, t[i].Period_Deadline);
+		print2uart("t[%i] @%#010x arg: %d idx: %d dl: %u ms\n", i, &t[i], t[i].arg, t[i].idx, (unsigned int)(t[i].Period_Deadline / 1000));
+
+	print2uart("IRQs masked at most %u us\n", irq_masked_max_us());
 
 	print2uart("Current\n");
-	print2uart("t[%i] @%#010x arg: %d dl: %d\n", current->idx, &current, current->arg, current->Period_Deadline);
+	print2uart("t[%i] @%#010x arg: %d dl: %u ms\n", current->idx, &current, current->arg, (unsigned int)(current->Period_Deadline / 1000));
 
 	print2uart("freeQ\n");
 	t = freeQ;
 	while (t)
 	{
-		print2uart("t[%i] @%#010x arg: %d dl: %d\n", t->idx, t, t->arg, t->Period_Deadline);
+		print2uart("t[%i] @%#010x arg: %d dl: %u ms\n", t->idx, t, t->arg, (unsigned int)(t->Period_Deadline / 1000));
 		t = t->next;
 	}
 
@@ -503,16 +1182,18 @@ void printTinyThreadsUART(void)
 	t = readyQ;
 	while (t)
 	{
-		print2uart("t[%i] @%#010x arg: %d dl: %d\n", t->idx, t, t->arg, t->Period_Deadline);
+		print2uart("t[%i] @%#010x arg: %d dl: %u ms\n", t->idx, t, t->arg, (unsigned int)(t->Period_Deadline / 1000));
 		t = t->next;
 	}
 	print2uart("doneQ\n");
 	t = doneQ;
 	while (t)
 	{
-		print2uart("t[%i] @%#010x arg: %d dl: %d\n", t->idx, t, t->arg, t->Period_Deadline);
+		print2uart("t[%i] @%#010x arg: %d dl: %u ms\n", t->idx, t, t->arg, (unsigned int)(t->Period_Deadline / 1000));
 		t = t->next;
 	}
+
+	irqstat_report();
 }
 
 /** @brief Prints on the PiFace the content of the main variables in TinyThreads
@@ -523,59 +1204,59 @@ void printTinyThreadsPiface(void)
 
 	piface_clear();
 	piface_puts("t for thread");
-	RPI_WaitMicroSeconds(2000000);
+	thread_sleep_us(2000000);
 
 	t = threads;
 	piface_clear();
 	piface_puts("Threads");
-	RPI_WaitMicroSeconds(2000000);
+	thread_sleep_us(2000000);
 	for (int i = 0; i < NTHREADS; i++)
 	{
 		piface_clear();
 		PUTTOLDC("t[%i] @%#010x (%d)", i, &t[i], t[i].arg);
-		RPI_WaitMicroSeconds(2000000);
+		thread_sleep_us(2000000);
 	}
 
 	piface_clear();
 	piface_puts("Current");
-	RPI_WaitMicroSeconds(2000000);
+	thread_sleep_us(2000000);
 	piface_clear();
 	PUTTOLDC("t[%i] @%#010x (%d)", current->idx, &current, current->arg);
-	RPI_WaitMicroSeconds(2000000);
+	thread_sleep_us(2000000);
 
 	piface_clear();
 	t = freeQ;
 	piface_puts("freeQ");
-	RPI_WaitMicroSeconds(2000000);
+	thread_sleep_us(2000000);
 	while (t)
 	{
 		piface_clear();
 		PUTTOLDC("t[%i] @%#010x (%d)", t->idx, t, t->arg);
-		RPI_WaitMicroSeconds(2000000);
+		thread_sleep_us(2000000);
 		t = t->next;
 	}
 
 	piface_clear();
 	t = readyQ;
 	piface_puts("readyQ");
-	RPI_WaitMicroSeconds(2000000);
+	thread_sleep_us(2000000);
 	while (t)
 	{
 		piface_clear();
 		PUTTOLDC("t[%i] @%#010x (%d)", t->idx, t, t->arg);
-		RPI_WaitMicroSeconds(2000000);
+		thread_sleep_us(2000000);
 		t = t->next;
 	}
 
 	piface_clear();
 	t = doneQ;
 	piface_puts("doneQ");
-	RPI_WaitMicroSeconds(2000000);
+	thread_sleep_us(2000000);
 	while (t)
 	{
 		piface_clear();
 		PUTTOLDC("t[%i] @%#010x (%d)", t->idx, t, t->arg);
-		RPI_WaitMicroSeconds(2000000);
+		thread_sleep_us(2000000);
 		t = t->next;
 	}
 	piface_clear();
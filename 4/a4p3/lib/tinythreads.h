@@ -9,8 +9,29 @@
 #ifndef _TINYTHREADS_H
 #define _TINYTHREADS_H
 
+#include <stdint.h>
+
 #define MUTEX_INIT {0,0}
 
+/* Deadline of threads without timing constraints */
+#define NO_DEADLINE UINT64_MAX
+
+/* Preemption threshold of fully preemptive threads */
+#define NO_THRESHOLD NO_DEADLINE
+
+/* Timeout of blocking calls that must not block */
+#define NO_WAIT 0
+
+/* Results of blocking calls */
+#define WAIT_OK         0
+#define WAIT_TIMEOUT    (-1)
+
+/* Scheduling policies, see set_scheduler() */
+#define SCHED_RR    0
+#define SCHED_RM    1
+#define SCHED_EDF   2
+#define SCHED_TT    3   // Table-driven, see cyclic.h
+
 struct thread_block;
 typedef struct thread_block *thread;
 
@@ -24,10 +45,33 @@ void lock(mutex *m);
 void unlock(mutex *m);
 
 void spawn(void (*code)(int), int arg);
-void spawnWithDeadline(void (* function)(int), int arg, unsigned int deadline, unsigned int rel_deadline);
+void spawnWithQuantum(void (*code)(int), int arg, unsigned int quantum);
+void spawnWithDeadline(void (* function)(int), int arg, uint64_t deadline, uint64_t rel_deadline);
+void spawnWithThreshold(void (*function)(int), int arg, uint64_t deadline, uint64_t rel_deadline, uint64_t threshold);
+void spawnService(void (*function)(int), int arg);
 void yield(void);
+void set_deadline(uint64_t deadline);
+void set_thread_deadline(thread t, uint64_t deadline);
+void set_thread_period(thread t, uint64_t rel_deadline);
+thread self(void);
 
 void scheduler(void);
+void pend_reschedule(void);
+void irq_enter(void);
+void irq_exit(void);
+int in_interrupt(void);
+void set_scheduler(int policy);
+int retire_periodic_tasks(void);
+
+/* Blocking primitives for kernel objects, call with IRQs masked */
+int wait_on(thread *waitQ, uint64_t timeout);
+int wait_on_data(thread *waitQ, uint64_t timeout, void *data);
+thread wake_one(thread *waitQ);
+int wake_matching(thread *waitQ, int (*match)(void *data, void *arg), void *arg);
+
+/* Sleeping, other threads run meanwhile */
+void thread_sleep_until(uint64_t wake_time);
+void thread_sleep_us(uint64_t us);
 
 void printTinyThreadsPiface(void);
 void printTinyThreadsUART(void);
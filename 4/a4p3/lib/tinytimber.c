@@ -0,0 +1,200 @@
+/*
+ * TinyTimber style reactive objects on top of TinyThreads.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tinytimber.h"
+#include "tinythreads.h"
+#include "rpi-interrupts.h"
+#include "rpi-systimer.h"
+
+struct msg_block {
+	Msg next;
+	uint64_t baseline;	// Absolute time at which the message may run
+	uint64_t deadline;	// Absolute deadline, NO_DEADLINE if none
+	Object *to;
+	Method meth;
+	int arg;
+};
+
+static struct msg_block messages[NMSGS];
+
+// @brief Unused messages.
+static Msg freeM = NULL;
+// @brief Messages whose baseline has not been reached, sorted by baseline.
+static Msg timerM = NULL;
+// @brief Messages ready to run, sorted by deadline.
+static Msg readyM = NULL;
+
+// @brief Idle workers wait here for a message.
+static thread workerQ = NULL;
+// @brief Each worker and the baseline of the message it runs.
+static thread worker_thread[NWORKERS];
+static uint64_t worker_baseline[NWORKERS];
+static int started = 0;
+
+static void insert_timer(Msg m)
+{
+	Msg *q = &timerM;
+
+	while (*q != NULL && (*q)->baseline <= m->baseline)
+		q = &(*q)->next;
+	m->next = *q;
+	*q = m;
+}
+
+static void insert_ready(Msg m)
+{
+	Msg *q = &readyM;
+
+	while (*q != NULL && (*q)->deadline <= m->deadline)
+		q = &(*q)->next;
+	m->next = *q;
+	*q = m;
+}
+
+/** @return the deadline of the message an idle worker runs next once it is
+ * woken up, which it waits with, so that it is not behind other threads
+ * in readyQ
+ */
+static uint64_t next_deadline(void)
+{
+	if (readyM != NULL)
+		return readyM->deadline;
+	return timerM != NULL ? timerM->deadline : NO_DEADLINE;
+}
+
+/** @brief Runs messages, earliest deadline first, as they become ready.
+ */
+static void worker(int i)
+{
+	irqflags_t flags = irqsave();
+
+	worker_thread[i] = self();
+	while (1)
+	{
+		uint64_t now = RPI_GetTimeMicroSeconds();
+
+		while (timerM != NULL && timerM->baseline <= now)
+		{
+			Msg m = timerM;
+
+			timerM = m->next;
+			insert_ready(m);
+		}
+
+		if (readyM == NULL)
+		{
+			set_deadline(next_deadline());
+			wait_on(&workerQ, timerM != NULL ? timerM->baseline : NO_DEADLINE);
+			continue;
+		}
+
+		Msg m = readyM;
+		readyM = m->next;
+		worker_baseline[i] = m->baseline;
+		set_deadline(m->deadline);
+
+		irqrestore(flags);
+		sync(m->to, m->meth, m->arg);
+		flags = irqsave();
+
+		m->next = freeM;
+		freeM = m;
+	}
+}
+
+/** @brief Builds the message pool and spawns the workers. Must be called
+ * from main before the first message is sent.
+ */
+void tinytimber_init(void)
+{
+	irqflags_t flags = irqsave();
+
+	if (started)
+	{
+		irqrestore(flags);
+		return;
+	}
+	for (int i = 0; i < NMSGS; i++)
+	{
+		messages[i].next = freeM;
+		freeM = &messages[i];
+	}
+	for (int i = 0; i < NWORKERS; i++)
+		spawn(worker, i);
+	started = 1;
+
+	irqrestore(flags);
+}
+
+/** @return the baseline of the message the calling thread runs, or the
+ * current time outside of methods and in interrupt handlers
+ */
+uint64_t baseline(void)
+{
+	thread t = self();
+
+	// self() is the interrupted thread, which may be a worker
+	if (started && !in_interrupt())
+	{
+		for (int i = 0; i < NWORKERS; i++)
+			if (worker_thread[i] == t)
+				return worker_baseline[i];
+	}
+	return RPI_GetTimeMicroSeconds();
+}
+
+/** @brief Queues a message to an object. May be called from interrupt
+ * handlers, where the baseline is the current time, once tinytimber_init()
+ * has run.
+ * @param offset is added to the baseline of the sender, in microseconds
+ * @param deadline is relative to the new baseline in microseconds, 0 for
+ * no deadline
+ * @return the message, or NULL if all NMSGS messages are pending or
+ * tinytimber_init() has not run
+ */
+Msg async(uint64_t offset, uint64_t deadline, Object *to, Method meth, int arg)
+{
+	Msg m;
+	irqflags_t flags = irqsave();
+
+	m = freeM;
+	if (m != NULL)
+	{
+		freeM = m->next;
+		m->baseline = baseline() + offset;
+		m->deadline = deadline != 0 ? m->baseline + deadline : NO_DEADLINE;
+		m->to = to;
+		m->meth = meth;
+		m->arg = arg;
+		if (m->baseline > RPI_GetTimeMicroSeconds())
+			insert_timer(m);
+		else
+			insert_ready(m);
+		// Also wakes an idle worker that must recompute its timeout
+		if (workerQ != NULL)
+			set_thread_deadline(workerQ, next_deadline());
+		wake_one(&workerQ);
+	}
+
+	irqrestore(flags);
+	return m;
+}
+
+/** @brief Calls a method of an object with the object locked, in the
+ * calling thread. Must not be called on an object whose method the
+ * caller is running, as the object mutex is not recursive.
+ * @return the result of the method
+ */
+int sync(Object *to, Method meth, int arg)
+{
+	int result;
+
+	lock(&to->m);
+	result = meth(to, arg);
+	unlock(&to->m);
+	return result;
+}
@@ -0,0 +1,74 @@
+/*
+ * TinyTimber style reactive objects on top of TinyThreads.
+ *
+ * An object is a struct that begins with an Object member. A method is a
+ * function int meth(Object *self, int arg) and runs with the object's
+ * mutex held, so the methods of an object never run concurrently.
+ * Methods are invoked by messages: ASYNC() queues a message and returns at
+ * once, AFTER() and BEFORE() do so with an offset on the baseline or a
+ * relative deadline, and SYNC() calls the method in the caller's thread.
+ *
+ * Queued messages run on a pool of NWORKERS worker threads in order of
+ * absolute deadline, and a worker competes with other threads with the
+ * deadline of the message it runs. The baseline of a message is the time
+ * it may run at the earliest. Messages sent from a method inherit the
+ * baseline of that method's message, so periodic activities keep their
+ * period without drift:
+ *
+ *   typedef struct { Object super; int count; } Counter;
+ *   Counter c = { initObject(), 0 };
+ *
+ *   int tick(Counter *self, int arg)
+ *   {
+ *       self->count++;
+ *       AFTER(MSEC(10), self, tick, arg);
+ *       return 0;
+ *   }
+ *   ...
+ *   tinytimber_init();
+ *   ASYNC(&c, tick, 0);
+ */
+
+#ifndef _TINYTIMBER_H
+#define _TINYTIMBER_H
+
+#include <stdint.h>
+
+#include "tinythreads.h"
+
+#ifndef NWORKERS
+#define NWORKERS 2  // Worker threads, taken from the TinyThreads pool
+#endif
+#define NMSGS 32    // Messages that can be pending at once
+
+#define USEC(x) ((uint64_t)(x))
+#define MSEC(x) ((uint64_t)(x) * 1000)
+#define SEC(x)  ((uint64_t)(x) * 1000000)
+
+typedef struct {
+    mutex m;
+} Object;
+
+#define initObject() { MUTEX_INIT }
+
+typedef int (*Method)(Object *self, int arg);
+
+struct msg_block;
+typedef struct msg_block *Msg;
+
+/* offset is added to the baseline, deadline is relative to the new
+   baseline, 0 for no deadline */
+#define SEND(offset, deadline, obj, meth, arg) \
+    async((offset), (deadline), (Object *)(obj), (Method)(meth), (arg))
+#define ASYNC(obj, meth, arg)               SEND(0, 0, obj, meth, arg)
+#define AFTER(offset, obj, meth, arg)       SEND(offset, 0, obj, meth, arg)
+#define BEFORE(deadline, obj, meth, arg)    SEND(0, deadline, obj, meth, arg)
+#define SYNC(obj, meth, arg) \
+    sync((Object *)(obj), (Method)(meth), (arg))
+
+void tinytimber_init(void);
+Msg async(uint64_t offset, uint64_t deadline, Object *to, Method meth, int arg);
+int sync(Object *to, Method meth, int arg);
+uint64_t baseline(void);
+
+#endif
@@ -0,0 +1,274 @@
+/*
+ * Offline preemption threshold assignment for the RM scheduler, see
+ * spawnWithThreshold() in lib/tinythreads.c.
+ *
+ * Reads a task set in the format of tools/ttgen, one task per line:
+ *
+ *   # function  wcet_us  period_us  [deadline_us  [arg]]
+ *
+ * TinyThreads threads have a single relative deadline, which is also
+ * their period, so the deadline column must be absent or equal to the
+ * period. Priorities are rate monotonic. Starting from the fully
+ * preemptive assignment, the threshold of each task, highest priority
+ * first, is raised as long as the response time analysis of Wang and
+ * Saksena still finds every task schedulable. The result is a maximal
+ * assignment: no single threshold can be raised further.
+ *
+ * The analysis holds for set_scheduler(SCHED_RM) only, which runs the
+ * shortest-period ready thread whose period is below the threshold of
+ * the running one. It does not cover SCHED_EDF.
+ *
+ * Writes to stdout a C header with one THRESHOLD_<FUNCTION> per task,
+ * the relative deadline to pass to spawnWithThreshold().
+ *
+ * Build and run on the host:
+ *   make tools/ptgen
+ *   tools/ptgen control.tasks > control_pt.h
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_TASKS 64
+#define MAX_NAME 64
+/* Busy periods longer than this are treated as unschedulable */
+#define MAX_BUSY_US (1000ULL * 1000 * 1000 * 1000)
+
+struct task {
+	char name[MAX_NAME];
+	uint64_t wcet;
+	uint64_t period;
+	uint64_t deadline;
+	int arg;
+	int threshold;		// Priority level, tasks[0] has the highest level ntasks - 1
+	uint64_t response;	// Worst-case response time with the current thresholds
+};
+
+static struct task tasks[MAX_TASKS];
+static int ntasks = 0;
+
+static int read_tasks(FILE *in)
+{
+	char line[256];
+	int lineno = 0;
+
+	while (fgets(line, sizeof(line), in) != NULL)
+	{
+		struct task *t = &tasks[ntasks];
+		unsigned long long wcet, period, deadline;
+		int n;
+
+		lineno++;
+		if (line[strspn(line, " \t")] == '#' || line[strspn(line, " \t\r\n")] == '\0')
+			continue;
+		if (ntasks == MAX_TASKS)
+		{
+			fprintf(stderr, "ptgen: more than %d tasks\n", MAX_TASKS);
+			return -1;
+		}
+
+		t->arg = 0;
+		n = sscanf(line, "%63s %llu %llu %llu %d", t->name, &wcet, &period, &deadline, &t->arg);
+		if (n < 3 || wcet == 0 || period == 0)
+		{
+			fprintf(stderr, "ptgen: line %d: expected function wcet period [deadline [arg]]\n", lineno);
+			return -1;
+		}
+		t->wcet = wcet;
+		t->period = period;
+		t->deadline = n >= 4 ? deadline : period;
+		if (t->deadline != t->period)
+		{
+			fprintf(stderr, "ptgen: line %d: deadline must equal the period\n", lineno);
+			return -1;
+		}
+		if (t->wcet > t->deadline)
+		{
+			fprintf(stderr, "ptgen: line %d: need wcet <= period\n", lineno);
+			return -1;
+		}
+		ntasks++;
+	}
+	return ntasks > 0 ? 0 : -1;
+}
+
+static int by_deadline(const void *a, const void *b)
+{
+	const struct task *x = a;
+	const struct task *y = b;
+
+	return (x->deadline > y->deadline) - (x->deadline < y->deadline);
+}
+
+static uint64_t div_ceil(uint64_t a, uint64_t b)
+{
+	return (a + b - 1) / b;
+}
+
+/* Priority level of tasks[i] */
+#define PRIO(i) (ntasks - 1 - (i))
+
+/** @brief Worst-case response time of tasks[i] under preemption thresholds.
+ * @return the response time, or UINT64_MAX if it exceeds the deadline
+ */
+static uint64_t response_time(int i)
+{
+	const struct task *ti = &tasks[i];
+	uint64_t blocking = 0;
+	uint64_t busy, prev;
+	uint64_t worst = 0;
+
+	// Blocking by a lower priority task whose threshold is at our level or above
+	for (int j = i + 1; j < ntasks; j++)
+		if (tasks[j].threshold >= PRIO(i) && tasks[j].wcet > blocking)
+			blocking = tasks[j].wcet;
+
+	// Level-i busy period
+	busy = blocking;
+	for (int j = 0; j <= i; j++)
+		busy += tasks[j].wcet;
+	do
+	{
+		prev = busy;
+		busy = blocking;
+		for (int j = 0; j <= i; j++)
+			busy += div_ceil(prev, tasks[j].period) * tasks[j].wcet;
+		if (busy > MAX_BUSY_US)
+			return UINT64_MAX;
+	} while (busy != prev);
+
+	for (uint64_t q = 0; q < div_ceil(busy, ti->period); q++)
+	{
+		uint64_t start = blocking + q * ti->wcet;
+		uint64_t finish;
+
+		// Start time, any higher priority task may still delay us
+		for (int j = 0; j < i; j++)
+			start += tasks[j].wcet;
+		do
+		{
+			prev = start;
+			start = blocking + q * ti->wcet;
+			for (int j = 0; j < i; j++)
+				start += (1 + prev / tasks[j].period) * tasks[j].wcet;
+			if (start > MAX_BUSY_US)
+				return UINT64_MAX;
+		} while (start != prev);
+
+		// Finish time, only tasks above our threshold preempt once started
+		finish = start + ti->wcet;
+		do
+		{
+			prev = finish;
+			finish = start + ti->wcet;
+			for (int j = 0; j < i; j++)
+				if (PRIO(j) > ti->threshold)
+					finish += (div_ceil(prev, tasks[j].period) - (1 + start / tasks[j].period)) * tasks[j].wcet;
+			if (finish > MAX_BUSY_US)
+				return UINT64_MAX;
+		} while (finish != prev);
+
+		if (finish - q * ti->period > worst)
+			worst = finish - q * ti->period;
+		if (worst > ti->deadline)
+			return UINT64_MAX;
+	}
+	return worst;
+}
+
+static int schedulable(void)
+{
+	for (int i = 0; i < ntasks; i++)
+	{
+		tasks[i].response = response_time(i);
+		if (tasks[i].response == UINT64_MAX)
+			return 0;
+	}
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *in;
+	double utilization = 0;
+
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: ptgen tasks-file > thresholds.h\n");
+		return 2;
+	}
+	in = fopen(argv[1], "r");
+	if (in == NULL)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+	if (read_tasks(in) != 0)
+	{
+		fprintf(stderr, "ptgen: no valid task set in %s\n", argv[1]);
+		return 1;
+	}
+	fclose(in);
+
+	qsort(tasks, ntasks, sizeof(tasks[0]), by_deadline);
+	for (int i = 0; i < ntasks; i++)
+	{
+		// Threads with equal periods never preempt each other
+		if (i > 0 && tasks[i].deadline == tasks[i - 1].deadline)
+		{
+			fprintf(stderr, "ptgen: %s and %s have the same deadline\n", tasks[i - 1].name, tasks[i].name);
+			return 1;
+		}
+		tasks[i].threshold = PRIO(i);
+		utilization += (double)tasks[i].wcet / tasks[i].period;
+	}
+
+	if (utilization > 1 || !schedulable())
+	{
+		fprintf(stderr, "ptgen: %s is not schedulable with RM, even fully preemptive\n", argv[1]);
+		return 1;
+	}
+
+	for (int i = 0; i < ntasks; i++)
+	{
+		while (tasks[i].threshold < ntasks - 1)
+		{
+			tasks[i].threshold++;
+			if (!schedulable())
+			{
+				tasks[i].threshold--;
+				break;
+			}
+		}
+	}
+	schedulable(); // Response times of the final assignment
+
+	printf("/* Generated by tools/ptgen from %s, do not edit. */\n", argv[1]);
+	printf("/* Thresholds for set_scheduler(SCHED_RM), not analysed under SCHED_EDF */\n\n");
+	printf("/* Utilization %.3f */\n\n", utilization);
+	for (int i = 0; i < ntasks; i++)
+	{
+		const struct task *t = &tasks[i];
+		char macro[MAX_NAME];
+		int dup = 0;
+
+		for (int k = 0; k < ntasks; k++)
+			dup |= k != i && strcmp(tasks[k].name, t->name) == 0;
+		for (int k = 0; k < MAX_NAME; k++)
+			macro[k] = toupper((unsigned char)t->name[k]);
+
+		// Threads with a shorter period than this one preempt the task
+		if (dup)
+			printf("#define THRESHOLD_%s_%d ", macro, t->arg);
+		else
+			printf("#define THRESHOLD_%s ", macro);
+		printf("%llu // period %llu us, wcet %llu us, response %llu us\n",
+			   (unsigned long long)tasks[ntasks - 1 - t->threshold].deadline,
+			   (unsigned long long)t->period, (unsigned long long)t->wcet,
+			   (unsigned long long)t->response);
+	}
+	return 0;
+}
@@ -0,0 +1,298 @@
+/*
+ * Offline schedule table generator for the cyclic executive, see lib/cyclic.h.
+ *
+ * Reads a task set, one task per line:
+ *
+ *   # function  wcet_us  period_us  [deadline_us  [arg]]
+ *   control     300      5000       5000         0
+ *   logger      1200     20000
+ *
+ * and writes to stdout a C file that defines
+ *
+ *   const tt_schedule <name>;
+ *
+ * The major frame is the hyperperiod. The minor frame is the largest
+ * divisor of the hyperperiod that holds the longest job, divides some
+ * period and satisfies 2f - gcd(P, f) <= D for every task, so each job
+ * has a whole frame between its release and its deadline. Jobs are not
+ * split across frames and are packed earliest deadline first. The frame
+ * loads are written as comments so the table can be reviewed.
+ *
+ * Build and run on the host:
+ *   make tools/ttgen
+ *   tools/ttgen control.tasks control_tt > control_tt.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_TASKS 64
+#define MAX_JOBS 4096
+#define MAX_NAME 64
+
+struct task {
+	char name[MAX_NAME];
+	uint64_t wcet;
+	uint64_t period;
+	uint64_t deadline;
+	int arg;
+};
+
+struct job {
+	int task;
+	uint64_t release;
+	uint64_t deadline;
+	int frame; // -1 while not placed
+};
+
+static struct task tasks[MAX_TASKS];
+static int ntasks = 0;
+static struct job jobs[MAX_JOBS];
+static int njobs = 0;
+
+static uint64_t gcd(uint64_t a, uint64_t b)
+{
+	while (b != 0)
+	{
+		uint64_t r = a % b;
+
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+static int read_tasks(FILE *in)
+{
+	char line[256];
+	int lineno = 0;
+
+	while (fgets(line, sizeof(line), in) != NULL)
+	{
+		struct task *t = &tasks[ntasks];
+		unsigned long long wcet, period, deadline;
+		int n;
+
+		lineno++;
+		if (line[strspn(line, " \t")] == '#' || line[strspn(line, " \t\r\n")] == '\0')
+			continue;
+		if (ntasks == MAX_TASKS)
+		{
+			fprintf(stderr, "ttgen: more than %d tasks\n", MAX_TASKS);
+			return -1;
+		}
+
+		t->arg = 0;
+		n = sscanf(line, "%63s %llu %llu %llu %d", t->name, &wcet, &period, &deadline, &t->arg);
+		if (n < 3 || wcet == 0 || period == 0)
+		{
+			fprintf(stderr, "ttgen: line %d: expected function wcet period [deadline [arg]]\n", lineno);
+			return -1;
+		}
+		t->wcet = wcet;
+		t->period = period;
+		t->deadline = n >= 4 ? deadline : period;
+		if (t->wcet > t->deadline || t->deadline > t->period)
+		{
+			fprintf(stderr, "ttgen: line %d: need wcet <= deadline <= period\n", lineno);
+			return -1;
+		}
+		ntasks++;
+	}
+	return ntasks > 0 ? 0 : -1;
+}
+
+/** @brief Tells if the minor frame length f meets the frame size constraints.
+ */
+static int frame_ok(uint64_t f)
+{
+	int divides = 0;
+
+	for (int i = 0; i < ntasks; i++)
+	{
+		if (f < tasks[i].wcet)
+			return 0;
+		if (2 * f - gcd(tasks[i].period, f) > tasks[i].deadline)
+			return 0;
+		if (tasks[i].period % f == 0)
+			divides = 1;
+	}
+	return divides;
+}
+
+/** @brief Places every job of the major frame in a minor frame of length f,
+ * earliest deadline first.
+ * @return 0 if all jobs meet their deadlines
+ */
+static int pack(uint64_t major, uint64_t f)
+{
+	int nframes = major / f;
+
+	for (int j = 0; j < njobs; j++)
+		jobs[j].frame = -1;
+
+	for (int k = 0; k < nframes; k++)
+	{
+		uint64_t start = k * f;
+		uint64_t end = start + f;
+		uint64_t load = 0;
+
+		while (1)
+		{
+			int best = -1;
+
+			for (int j = 0; j < njobs; j++)
+			{
+				if (jobs[j].frame >= 0 || jobs[j].release > start)
+					continue;
+				if (jobs[j].deadline < end)
+					return -1; // Released, but no whole frame is left before its deadline
+				if (load + tasks[jobs[j].task].wcet > f)
+					continue;
+				if (best < 0 || jobs[j].deadline < jobs[best].deadline)
+					best = j;
+			}
+			if (best < 0)
+				break;
+			jobs[best].frame = k;
+			load += tasks[jobs[best].task].wcet;
+		}
+	}
+
+	for (int j = 0; j < njobs; j++)
+		if (jobs[j].frame < 0)
+			return -1;
+	return 0;
+}
+
+static void emit(FILE *out, const char *name, const char *source, uint64_t major, uint64_t f)
+{
+	int nframes = major / f;
+	int pos = 0;
+
+	fprintf(out, "/* Generated by tools/ttgen from %s, do not edit. */\n\n", source);
+	fprintf(out, "#include <stdint.h>\n\n#include \"cyclic.h\"\n\n");
+	fprintf(out, "/* Major frame %llu us, %d minor frames of %llu us */\n\n",
+			(unsigned long long)major, nframes, (unsigned long long)f);
+
+	for (int i = 0; i < ntasks; i++)
+	{
+		int seen = 0;
+
+		for (int k = 0; k < i; k++)
+			seen |= strcmp(tasks[k].name, tasks[i].name) == 0;
+		if (!seen)
+			fprintf(out, "void %s(int);\n", tasks[i].name);
+	}
+
+	fprintf(out, "\nstatic const tt_task %s_tasks[] = {\n", name);
+	for (int i = 0; i < ntasks; i++)
+		fprintf(out, "    {%s, %d}, // wcet %llu us, period %llu us, deadline %llu us\n",
+				tasks[i].name, tasks[i].arg, (unsigned long long)tasks[i].wcet,
+				(unsigned long long)tasks[i].period, (unsigned long long)tasks[i].deadline);
+	fprintf(out, "};\n");
+
+	fprintf(out, "\nstatic const uint8_t %s_jobs[] = {\n", name);
+	for (int k = 0; k < nframes; k++)
+	{
+		uint64_t load = 0;
+
+		fprintf(out, "    ");
+		// Within a frame, jobs run in deadline order
+		for (int placed = 1; placed;)
+		{
+			int best = -1;
+
+			placed = 0;
+			for (int j = 0; j < njobs; j++)
+				if (jobs[j].frame == k && (best < 0 || jobs[j].deadline < jobs[best].deadline))
+					best = j;
+			if (best >= 0)
+			{
+				fprintf(out, "%d, ", jobs[best].task);
+				load += tasks[jobs[best].task].wcet;
+				jobs[best].frame = -2 - k; // Printed
+				placed = 1;
+			}
+		}
+		fprintf(out, "// frame %d, load %llu/%llu us\n", k, (unsigned long long)load, (unsigned long long)f);
+	}
+	fprintf(out, "};\n");
+
+	fprintf(out, "\nstatic const uint16_t %s_frame_start[] = {\n    ", name);
+	for (int k = 0; k < nframes; k++)
+	{
+		fprintf(out, "%d, ", pos);
+		for (int j = 0; j < njobs; j++)
+			pos += jobs[j].frame == -2 - k;
+	}
+	fprintf(out, "%d\n};\n", pos);
+
+	fprintf(out, "\nconst tt_schedule %s = {\n", name);
+	fprintf(out, "    %llu, %d, %s_frame_start, %s_jobs, %s_tasks\n};\n",
+			(unsigned long long)f, nframes, name, name, name);
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *in;
+	uint64_t major = 1;
+	uint64_t f;
+
+	if (argc != 3)
+	{
+		fprintf(stderr, "usage: ttgen tasks-file table-name > table.c\n");
+		return 2;
+	}
+	in = fopen(argv[1], "r");
+	if (in == NULL)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+	if (read_tasks(in) != 0)
+	{
+		fprintf(stderr, "ttgen: no valid task set in %s\n", argv[1]);
+		return 1;
+	}
+	fclose(in);
+
+	for (int i = 0; i < ntasks; i++)
+		major = major / gcd(major, tasks[i].period) * tasks[i].period;
+
+	for (int i = 0; i < ntasks; i++)
+	{
+		for (uint64_t r = 0; r < major; r += tasks[i].period)
+		{
+			if (njobs == MAX_JOBS)
+			{
+				fprintf(stderr, "ttgen: more than %d jobs in the major frame of %llu us\n",
+						MAX_JOBS, (unsigned long long)major);
+				return 1;
+			}
+			jobs[njobs].task = i;
+			jobs[njobs].release = r;
+			jobs[njobs].deadline = r + tasks[i].deadline;
+			njobs++;
+		}
+	}
+	// Largest frame first, for the smallest table and fewest frame switches
+	for (f = major; f > 0; f--)
+	{
+		if (major % f != 0 || !frame_ok(f))
+			continue;
+		if (major / f > UINT16_MAX - 1 || pack(major, f) != 0)
+			continue;
+
+		emit(stdout, argv[2], argv[1], major, f);
+		fprintf(stderr, "ttgen: %s: major frame %llu us, %llu frames of %llu us, %d jobs\n",
+				argv[2], (unsigned long long)major, (unsigned long long)(major / f),
+				(unsigned long long)f, njobs);
+		return 0;
+	}
+
+	fprintf(stderr, "ttgen: no feasible frame size for %s\n", argv[1]);
+	return 1;
+}